@@ -4,8 +4,6 @@
 //  Created 20.2.2016
 //  Modification: Jérôme Moret & Dousse Kewin 06.04.2017
 
-#define sizeMatrix 2048
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +13,21 @@
 #include <sys/timeb.h>
 #include <omp.h>
 
+#include "arena.h"
+#include "gemm.h"
+#include "gemmt.h"
+#include "matio.h"
+#include "strassen.h"
+#include "ooc.h"
+#include "batch.h"
+#include "bench.h"
+#include "tune.h"
+#include "verify.h"
+#include "sparse.h"
+#include "chain.h"
+
+#define TILE_NB 512     // columns of C per task in dynamic mode (multiple of every kernel NR)
+
 unsigned long my_ftime() {
     struct timeval t;
 
@@ -34,12 +47,12 @@ double *free_real_matrix(double *matrix, int size) {
          matrix[i] = NULL;
       }
 #endif
-    free(matrix);       // frees the pointer /
+    matrix_free(matrix); // frees the pointer /
     return NULL;        //returns a null pointer /
 }
 
 //-- ----------------------------------------------------------------------------
-// This function allocates a square matrix using malloc, and initializes it.
+// This function allocates a square matrix (see arena.h), and initializes it in parallel.
 // if 'random' is 0, initialize matrix to all 0s
 // if 'random' is -1, it initializes the matrix with random values (0->9).
 // if 'random' is -2 the matrix is initialized with no values in it.
@@ -51,7 +64,7 @@ double *allocate_real_matrix(int size, int random) {
 
     // allocates one vector of vectors (2D array = matrix)
     //matrix = (double**) malloc(n * sizeof(double*));
-    matrix = (double*) malloc(n*n * sizeof(double));
+    matrix = matrix_alloc((size_t) n * n);  // 64 bytes aligned, from the arena if it has room
 
     if (matrix == NULL) {
         fprintf (stderr, "** Error in matrix creation: insufficient memory **");
@@ -60,10 +73,12 @@ double *allocate_real_matrix(int size, int random) {
         //return (NULL);
     }
     if (random == 0)
+        #pragma omp parallel for private(j) schedule(static)
         for (i=0; i < size; ++i)
             for (j = 0; j < m; j++)
                 matrix[i*size+j] = 0;
     else if (random == -1)
+        #pragma omp parallel for private(j) schedule(static)
         for (i=0; i < size; ++i)
             for (j = 0; j < m; j++)
                 matrix[i*size+j] = i+1;// rand() % 10;  // Initialize with a random value between 0 and 9
@@ -76,12 +91,12 @@ double *allocate_real_matrix(int size, int random) {
 }
 
 //-- ----------------------------------------------------------------------------*/
-// Display 'size'x'size' elements of 'matrix' for debugging purposes
-void display(double *matrix, int size, int atmost) {
+// Display 'size'x'size' elements of 'matrix' (of element type 'type', see gemmt.h) for debugging purposes
+void display_typed(const void *matrix, elem_t type, int size, int atmost) {
     int i, j, limit = size < atmost ? size : atmost;
     for (i=0; i<limit; i++) {
         for (j=0; j<limit; j++)
-            fprintf(stderr, "%6.1lf ", matrix[i*size+j]);
+            fprintf(stderr, "%6.1lf ", elem_out_value(type, matrix, i*size+j));
         //printf("%6.1lf ", (double)(*matrix+(i*size+j)));
         if (atmost < size) fprintf(stderr, "...");
         fprintf(stderr, "\n");
@@ -90,18 +105,285 @@ void display(double *matrix, int size, int atmost) {
     fprintf(stderr, "\n-----------------------\n");
 }
 
+void display(double *matrix, int size, int atmost) {
+    display_typed(matrix, ELEM_F64, size, atmost);
+}
+
 // -- --------------------------------------------------------------------
-// dump matrix in binary format - simply to allow quick compare with another result file
-void dump(double *matrix, int size, FILE *f) {
-    if (fwrite(matrix, sizeof(double), size, f) != size)
+// dump the whole matrix in raw binary format - simply to allow quick compare with another result file
+void dump_typed(const void *matrix, size_t elemSize, int size, FILE *f) {
+    if (fwrite(matrix, elemSize, (size_t) size * size, f) != (size_t) size * size)
         fprintf(stderr, "Couldn't dump results to file\n");
 }
 
+void dump(double *matrix, int size, FILE *f) {
+    dump_typed(matrix, sizeof(double), size, f);
+}
+
 // -- -----------------------------------------------------------
-int main (int argc, char* argv[]) {
-    int size, debug=0;
+// C = A * B for an element type other than double (type=float|int32|mixed, see gemmt.h)
+void multiply_typed(int size, elem_t type, int debug, char *resultFileName) {
+    unsigned long start_time_lt, initTime, packTime, compTime;
+    size_t in = elem_in_size(type), out = elem_out_size(type);
+    int i;
+
+    start_time_lt =  my_ftime();  //-- -------------------------- Take starting Time
+
+    void *A = elem_alloc((size_t) size * size, in);
+    void *B = elem_alloc((size_t) size * size, in);
+    void *C = elem_alloc((size_t) size * size, out);
+    void *Bp = elem_alloc(elem_packed_size(type, size), in);
+    if (A == NULL || B == NULL || C == NULL || Bp == NULL) {
+        fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    elem_fill(type, A, size, 0, size);
+    elem_fill(type, B, size, 0, size);
+
+    initTime = my_ftime() - start_time_lt;  //-- ----------------- Measure init. Time
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < elem_pack_panels(type, size); i++)
+        elem_pack_panel(type, size, B, Bp, i);
+
+    packTime = my_ftime() - start_time_lt - initTime;  //-- --------- Measure packing Time
+
+    // Each thread computes whole blocks of gemm_mc rows
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < size; i += gemm_mc)
+        elem_rows(type, size, (char *) A + (size_t) i * size * in, Bp, (char *) C + (size_t) i * size * out,
+                  i, GEMM_MIN(i + gemm_mc, size));
+
+    compTime = my_ftime() - start_time_lt - initTime - packTime; //-- --------Measure computing Time
+
+    printf("Times (init, packing and computing) = %.4g, %.4g, %.4g sec\n\n",
+           initTime/1000.0, packTime/1000.0, compTime/1000.0);
+    printf("size=%d\ttype=%s\tinitTime=%g\tpackTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, elem_names[type],
+           initTime/1000.0, packTime/1000.0, compTime/1000.0,
+           (compTime/1000)/60, (compTime/1000)%60);
+    if (debug) { fprintf(stderr, "C[%dx%d]=A*B:\n", size, size); display_typed(C, type, size, size < 100? size:100);}
+
+    if (resultFileName!=NULL) {
+        ++resultFileName;      // strchr points to the '=' sign
+        FILE* f = fopen(resultFileName, "w");
+        if (f == NULL)
+            fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+        else {
+            dump_typed(C, out, size, f);
+            fclose(f);
+        }
+    }
+}
+
+// -- -----------------------------------------------------------
+// 'count' independent products of 'n'x'n' matrices (batch=count, see batch.h)
+void multiply_batch(int n, long count, int huge, int debug, char *resultFileName) {
+    unsigned long start_time_lt, initTime, compTime;
+    size_t total = (size_t) count * n * n;
+
+    start_time_lt =  my_ftime();  //-- -------------------------- Take starting Time
+
+    arena_init(3 * arena_bytes(total), huge);
+    double *A = matrix_alloc(total), *B = matrix_alloc(total), *C = matrix_alloc(total);
+    if (A == NULL || B == NULL || C == NULL) {
+        fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    batch_fill(n, 0, count, A, B);
+
+    initTime = my_ftime() - start_time_lt;  //-- ----------------- Measure init. Time
+
+    batch_multiply(n, count, A, B, C);
+
+    compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+
+    printf("Times (init and computing) = %.4g, %.4g sec\n\n", initTime/1000.0, compTime/1000.0);
+    printf("size=%d\tbatch=%ld\tinitTime=%g\tcomputeTime=%g\tmultipliesPerSec=%.0f\n", n, count, initTime/1000.0,
+           compTime/1000.0, compTime > 0 ? count * 1000.0 / compTime : 0.0);
+    if (debug) { fprintf(stderr, "C_0[%dx%d]=A_0*B_0:\n", n, n); display(C, n, n < 100? n:100);}
+
+    if (resultFileName!=NULL) {
+        ++resultFileName;      // strchr points to the '=' sign
+        FILE* f = fopen(resultFileName, "w");
+        if (f == NULL)
+            fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+        else {
+            if (fwrite(C, sizeof(double), total, f) != total)
+                fprintf(stderr, "Couldn't dump results to file\n");
+            fclose(f);
+        }
+    }
+}
+
+// -- -----------------------------------------------------------
+// C = alpha * op(A) * op(B) + beta * C with op(A) MxK and op(B) KxN (gemm=MxNxK, see gemm_ex).
+// The stored operands are filled with row + 1, C with 1.
+void multiply_rect(int M, int N, int K, int transA, int transB, double alpha, double beta, int debug,
+                   char *resultFileName) {
+    unsigned long start_time_lt, initTime, compTime;
+    int ra = transA ? K : M, ca = transA ? M : K, rb = transB ? N : K, cb = transB ? K : N, i, j;
+
+    start_time_lt =  my_ftime();  //-- -------------------------- Take starting Time
+
+    double *A = matrix_alloc((size_t) ra * ca), *B = matrix_alloc((size_t) rb * cb), *C = matrix_alloc((size_t) M * N);
+    if (A == NULL || B == NULL || C == NULL) {
+        fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    #pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < ra; i++)
+        for (j = 0; j < ca; j++) A[(long) i * ca + j] = i + 1;
+    #pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < rb; i++)
+        for (j = 0; j < cb; j++) B[(long) i * cb + j] = i + 1;
+    #pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < M; i++)
+        for (j = 0; j < N; j++) C[(long) i * N + j] = 1;
+
+    initTime = my_ftime() - start_time_lt;  //-- ----------------- Measure init. Time
+
+    gemm_ex(transA, transB, M, N, K, alpha, A, ca, B, cb, beta, C, N);
+
+    compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+
+    printf("Times (init and computing) = %.4g, %.4g sec\n\n", initTime/1000.0, compTime/1000.0);
+    printf("M=%d\tN=%d\tK=%d\ttransA=%d\ttransB=%d\tinitTime=%g\tcomputeTime=%g\tGFLOPS=%.2f\n", M, N, K, transA,
+           transB, initTime/1000.0, compTime/1000.0, compTime > 0 ? 2.0 * M * N * K / compTime / 1e6 : 0.0);
+    if (debug) fprintf(stderr, "C[0][0]=%g\tC[%d][%d]=%g\n", C[0], M - 1, N - 1, C[(long) M * N - 1]);
+
+    if (resultFileName!=NULL) {
+        ++resultFileName;      // strchr points to the '=' sign
+        FILE* f = fopen(resultFileName, "w");
+        if (f == NULL)
+            fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+        else {
+            if (fwrite(C, sizeof(double), (size_t) M * N, f) != (size_t) M * N)
+                fprintf(stderr, "Couldn't dump results to file\n");
+            fclose(f);
+        }
+    }
+}
+
+// -- -----------------------------------------------------------
+// Product of the chain or power planned in 'ch' (chain=, power=, see chain.h).
+// Every factor is filled with row + 1. Returns 1 if the verification failed.
+int multiply_chain(chain_t *ch, int verify, int debug, char *resultFileName) {
     unsigned long start_time_lt, initTime, compTime;
+    int factors = ch->power > 0 ? 1 : ch->n, M = ch->dims[0], N = ch->dims[ch->n], failed = 0, t, i, j;
+    double *factor[CHAIN_MAX], *C;
+    char order[1024];
+
+    start_time_lt =  my_ftime();  //-- -------------------------- Take starting Time
+
+    for (t = 0; t < factors; t++) {
+        int rows = ch->dims[t], cols = ch->dims[t + 1];
+        factor[t] = matrix_alloc((size_t) rows * cols);
+        if (factor[t] == NULL) {
+            fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+            fprintf(stderr, "** Program aborted................................ **");
+            exit(1);
+        }
+        #pragma omp parallel for private(j) schedule(static)
+        for (i = 0; i < rows; i++)
+            for (j = 0; j < cols; j++) factor[t][(long) i * cols + j] = i + 1;
+        ch->factor[t] = factor[t];
+    }
+    C = matrix_alloc((size_t) M * N);
+    if (C == NULL) {
+        fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+
+    initTime = my_ftime() - start_time_lt;  //-- ----------------- Measure init. Time
+
+    chain_eval(ch, C);
+
+    compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+
+    chain_format(ch, order, sizeof(order));
+    printf("Times (init and computing) = %.4g, %.4g sec\n\n", initTime/1000.0, compTime/1000.0);
+    printf("M=%d\tN=%d\torder=%s\tproducts=%ld\tflops=%.4g\tleftToRightFlops=%.4g\tinitTime=%g\tcomputeTime=%g\t"
+           "GFLOPS=%.2f\n", M, N, order, ch->products, ch->flops, chain_flops(ch, 1), initTime/1000.0,
+           compTime/1000.0, compTime > 0 ? ch->flops / compTime / 1e6 : 0.0);
+    if (debug) fprintf(stderr, "C[0][0]=%g\tC[%d][%d]=%g\n", C[0], M - 1, N - 1, C[(long) M * N - 1]);
+    if (verify > 0) {
+        unsigned long seed = verify_seed();
+        failed = verify_report_freivalds(chain_freivalds(ch, C, verify, seed), chain_tol_size(ch), verify, seed);
+    }
+
+    if (resultFileName!=NULL) {
+        ++resultFileName;      // strchr points to the '=' sign
+        FILE* f = fopen(resultFileName, "w");
+        if (f == NULL)
+            fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+        else {
+            if (fwrite(C, sizeof(double), (size_t) M * N, f) != (size_t) M * N)
+                fprintf(stderr, "Couldn't dump results to file\n");
+            fclose(f);
+        }
+    }
+    for (t = 0; t < factors; t++)
+        matrix_free(factor[t]);
+    matrix_free(C);
+    chain_free(ch);
+    return failed;
+}
+
+// -- -----------------------------------------------------------
+// One complete multiply for the benchmark: packing of B (if 'Bp' is not NULL)
+// and computation with the selected kernel
+void multiply_once(int size, double *A, double *B, double *Bp, double *C, int naive, int dynamic, int strassen,
+                   int cutoff) {
+    int i, j;
+
+    if (naive) {
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < size; i++)
+            gemm_naive_rows(size, A, B, C, i, i + 1);
+        return;
+    }
+    if (strassen) {
+        strassen_multiply(size, A, B, C, cutoff);
+        return;
+    }
+    if (Bp != NULL) {
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < gemm_pack_b_panels(size); i++)
+            gemm_pack_b_panel(size, B, Bp, i);
+    }
+    if (dynamic) {
+        #pragma omp parallel
+        #pragma omp single
+        #pragma omp taskloop collapse(2) grainsize(1)
+        for (i = 0; i < size; i += gemm_mc)
+            for (j = 0; j < size; j += TILE_NB)
+                gemm_tile(size, A, B, Bp, C, i, GEMM_MIN(i + gemm_mc, size), j, GEMM_MIN(j + TILE_NB, size));
+    } else {
+        #pragma omp parallel for schedule(runtime)
+        for (i = 0; i < size; i += gemm_mc)
+            gemm_block_rows_ex(size, A, B, Bp, C, i, GEMM_MIN(i + gemm_mc, size));
+    }
+}
+
+// -- -----------------------------------------------------------
+int main (int argc, char* argv[]) {
+    int size=0, debug=0, pack=1, huge=0, dynamic=0, strassen=0, cutoff=STRASSEN_CUTOFF, ooc=0, memMB=OOC_DEFAULT_MEM, type=ELEM_F64;
+    long batch=0;
+    int naive=0, reps=0, warmup=1, json=0, tune=0, verify=0, checksum=0, sparse=-1;
+    double density=1;
+    char *benchFile = NULL;
+    int M=0, N=0, K=0, transA=0, transB=0;
+    int chainDims[CHAIN_MAX + 1], factors=0, power=0;
+    double alpha=1, beta=0;
+    unsigned long start_time_lt, initTime, packTime, compTime;
     char* resultFileName = NULL;
+    char *fileA = NULL, *fileB = NULL, *fileC = NULL;  // matrix files, see matio.h
+    matio_map_t mapA = {0}, mapB = {0}, mapC = {0};
+    matio_header_t hdr;
     register int i, j, k;
 
     // rudimentary argument collecting
@@ -110,46 +392,272 @@ int main (int argc, char* argv[]) {
             size = atoi(argv[k]);
         else if (strncmp(argv[k], "dump", 4) == 0) // assume dump=filename
             resultFileName=strchr(argv[k],'=');
+        else if (strcmp(argv[k], "nopack") == 0)   // multiply B in place, no packing
+            pack = 0;
+        else if (strcmp(argv[k], "naive") == 0)    // original triple loop (benchmark baseline)
+            naive = 1;
+        else if (strncmp(argv[k], "verify", 6) == 0) // verify or verify=rounds: Freivalds check of C
+            verify = argv[k][6] == '=' ? atoi(argv[k] + 7) : 1;
+        else if (strcmp(argv[k], "checksum") == 0) // checksum of C against the one expected from A and B
+            checksum = 1;
+        else if (strcmp(argv[k], "sparse") == 0)   // CSR kernel for A (default: when A is sparse enough)
+            sparse = 1;
+        else if (strcmp(argv[k], "dense") == 0)    // dense kernel whatever the density of A
+            sparse = 0;
+        else if (strncmp(argv[k], "density=", 8) == 0) // generate A with this fraction of nonzeros
+            density = atof(argv[k] + 8);
+        else if (strcmp(argv[k], "tune") == 0)     // search the best configuration of this host and cache it
+            tune = 1;
+        else if (bench_option(argv[k], &reps, &warmup, &benchFile, &json)) // bench=, warmup=, csv=, json=
+            ;
+        else if (strcmp(argv[k], "huge") == 0)     // back the matrices with 2 MB pages
+            huge = 1;
+        else if (strncmp(argv[k], "A=", 2) == 0)   // read A from a matrix file
+            fileA = argv[k] + 2;
+        else if (strncmp(argv[k], "B=", 2) == 0)   // read B from a matrix file
+            fileB = argv[k] + 2;
+        else if (strncmp(argv[k], "out=", 4) == 0) // write C to a matrix file
+            fileC = argv[k] + 4;
+        else if (strcmp(argv[k], "dynamic") == 0)  // tiles handed out as OpenMP tasks
+            dynamic = 1;
+        else if (strncmp(argv[k], "strassen", 8) == 0) { // strassen or strassen=cutoff
+            strassen = 1;
+            if (argv[k][8] == '=' && (cutoff = atoi(argv[k] + 9)) <= 0) {
+                fprintf(stderr, "** strassen=<cutoff> expects a positive cutoff **\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[k], "ooc") == 0)      // out-of-core: stream tiles of A=, B= to out=
+            ooc = 1;
+        else if (strncmp(argv[k], "mem=", 4) == 0) { // memory budget of the out-of-core mode (MB)
+            if ((memMB = atoi(argv[k] + 4)) <= 0) {
+                fprintf(stderr, "** mem=<MB> expects a positive budget **\n");
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[k], "gemm=", 5) == 0) { // gemm=MxNxK rectangular product
+            if (sscanf(argv[k] + 5, "%dx%dx%d", &M, &N, &K) != 3 || M <= 0 || N <= 0 || K <= 0) {
+                fprintf(stderr, "** gemm=MxNxK expected **\n");
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[k], "chain=", 6) == 0) { // chain=p0xp1x...xpn product of factors pt x pt+1
+            if ((factors = chain_parse(argv[k] + 6, chainDims)) < 0) {
+                fprintf(stderr, "** chain=p0xp1x...xpn expected (at most %d factors) **\n", CHAIN_MAX);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[k], "power=", 6) == 0) { // power=k: A^k by repeated squaring
+            if ((power = atoi(argv[k] + 6)) < 1) {
+                fprintf(stderr, "** power=<k> expects a power of 1 or more **\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[k], "transA") == 0)   // gemm: op(A) = A transposed
+            transA = 1;
+        else if (strcmp(argv[k], "transB") == 0)   // gemm: op(B) = B transposed
+            transB = 1;
+        else if (strncmp(argv[k], "alpha=", 6) == 0)
+            alpha = atof(argv[k] + 6);
+        else if (strncmp(argv[k], "beta=", 5) == 0)
+            beta = atof(argv[k] + 5);
+        else if (strncmp(argv[k], "batch=", 6) == 0) // batch=count independent size x size products
+            batch = atol(argv[k] + 6);
+        else if (strncmp(argv[k], "type=", 5) == 0) { // element type: double, float, int32 or mixed
+            if ((type = elem_parse(argv[k] + 5)) < 0) {
+                fprintf(stderr, "** Unknown element type %s **\n", argv[k] + 5);
+                exit(1);
+            }
+        }
         else if (debug=strncmp(argv[k], "debug", 5) == 0) // want debuging info
             fprintf(stderr, "debug is now on.\n");
     }
 
+    // Operands read from files give the size
+    if ((fileA != NULL && matio_square_size(fileA, &size) != 0) || (fileB != NULL && matio_square_size(fileB, &size) != 0))
+        exit(1);
+    if ((verify > 0 || checksum) && (M > 0 || batch > 0 || type != ELEM_F64 || ooc || reps > 0)) {
+        fprintf(stderr, "** verify and checksum check a single square double product **\n");
+        exit(1);
+    }
+    if ((sparse > 0 || density < 1) && (M > 0 || batch > 0 || type != ELEM_F64 || ooc || reps > 0 || strassen || dynamic ||
+                                        naive)) {
+        fprintf(stderr, "** sparse and density= only apply to the default double product **\n");
+        exit(1);
+    }
+
     if (debug) fprintf(stderr, "\nStart sequential standard algorithm (size=%d)...\n", size);
 
+    const gemm_kernel_t *kern = gemm_init();
+    if (debug) fprintf(stderr, "Using %s micro kernel (%dx%d)\n", kern->name, kern->mr, kern->nr);
+
+    // Block sizes, threads and schedule: searched (tune), or those cached for this host
+    tune_config_t tuned;
+    if (tune) {
+        tune_search(size > 0 ? size : TUNE_SIZE, debug, &tuned);
+        printf("kernel=%s\tMC=%d\tKC=%d\tNC=%d\tthreads=%d\tschedule=%s\tranksPerNode=%d\tgflops=%.2f\n",
+               tuned.kernel, tuned.mc, tuned.kc, tuned.nc, tuned.threads, tune_schedule_names[tuned.schedule],
+               tuned.ranks, tuned.gflops);
+        return tune_save(&tuned) != 0;
+    }
+    tune_load(&tuned, 1, debug);
+
     start_time_lt =  my_ftime();  //-- -------------------------- Take starting Time
 
-    register double* A=allocate_real_matrix(size, -1);
-    register double* B=allocate_real_matrix(size, -1);
-    register double* C=allocate_real_matrix(size, -2);
+    if (factors > 0 || power > 0) {
+        chain_t ch;
+        size_t bytes = 0;
+        if ((factors > 0 && power > 0) || (power > 0 && size <= 0) || M > 0 || batch > 0 || type != ELEM_F64 ||
+            fileA != NULL || fileB != NULL || fileC != NULL || ooc || strassen || dynamic || sparse > 0 || checksum) {
+            fprintf(stderr, "** chain= or power= (with a size) only multiply generated double matrices **\n");
+            exit(1);
+        }
+        chain_init(&ch, 0, 1, NULL);
+        if (power > 0)
+            chain_plan_power(&ch, size, power);
+        else
+            chain_plan(&ch, factors, chainDims);
+        for (i = 0; i < (power > 0 ? 1 : factors); i++)
+            bytes += arena_bytes((size_t) ch.dims[i] * ch.dims[i + 1]);
+        arena_init(bytes + arena_bytes((size_t) ch.dims[0] * ch.dims[ch.n]), huge);
+        return multiply_chain(&ch, verify, debug, resultFileName);
+    }
+
+    if (M > 0) {
+        if (type != ELEM_F64 || batch > 0 || fileA != NULL || fileB != NULL || fileC != NULL || ooc || strassen || dynamic) {
+            fprintf(stderr, "** gemm only multiplies generated double matrices **\n");
+            exit(1);
+        }
+        arena_init(arena_bytes((size_t) M * K) + arena_bytes((size_t) K * N) + arena_bytes((size_t) M * N), huge);
+        multiply_rect(M, N, K, transA, transB, alpha, beta, debug, resultFileName);
+        return 0;
+    }
+
+    if (batch > 0) {
+        if (type != ELEM_F64 || fileA != NULL || fileB != NULL || fileC != NULL || ooc || strassen || dynamic) {
+            fprintf(stderr, "** batch only multiplies generated double matrices **\n");
+            exit(1);
+        }
+        multiply_batch(size, batch, huge, debug, resultFileName);
+        return 0;
+    }
 
+    // Out-of-core: only tiles of the matrices are ever in memory
+    if (ooc) {
+        ooc_stats_t st;
+        if (fileA == NULL || fileB == NULL || fileC == NULL || resultFileName != NULL) {
+            fprintf(stderr, "** ooc needs A=, B= and out= (and no dump) **\n");
+            exit(1);
+        }
+        if (ooc_create(fileC, size) != 0 ||
+            ooc_multiply(fileA, fileB, fileC, size, 0, size, (size_t) memMB << 20, debug, &st) != 0)
+            exit(1);
+        compTime = my_ftime() - start_time_lt; //-- --------Measure computing Time
+        printf("size=%d\tcomputeTime=%g\ttile=%dx%d\treadMB=%.0f\twriteMB=%.0f\twaitTime=%g\twriteTime=%g\n", size,
+               compTime/1000.0, st.tile, st.depth, st.readBytes / 1048576, st.writeBytes / 1048576, st.waitTime,
+               st.writeTime);
+        return 0;
+    }
+
+    // One arena for A, B, C and the packed copy of B
+    arena_init(3 * arena_bytes((size_t) size * size) + arena_bytes(gemm_packed_b_size(size)), huge);
+
+    if (type != ELEM_F64) {
+        if (fileA != NULL || fileB != NULL || fileC != NULL || ooc || strassen || dynamic) {
+            fprintf(stderr, "** Matrix files, ooc, strassen and dynamic only handle doubles **\n");
+            exit(1);
+        }
+        multiply_typed(size, type, debug, resultFileName);
+        return 0;
+    }
+
+    register double* A=fileA != NULL ? matio_map_read(fileA, &hdr, &mapA) : allocate_real_matrix(size, -1);
+    register double* B=fileB != NULL ? matio_map_read(fileB, &hdr, &mapB) : allocate_real_matrix(size, -1);
+    register double* C=fileC != NULL ? matio_map_create(fileC, size, size, &mapC) : allocate_real_matrix(size, -2);
+
+    if (A == NULL || B == NULL || C == NULL) exit(1);  // matrix file errors are already reported
+    if (fileA == NULL) sparse_thin(A, size, size, 0, density);
     if (debug) fprintf(stderr, "Created Matrices A, B and C of size %dx%d\n", size, size);
 
     initTime = my_ftime() - start_time_lt;  //-- ----------------- Measure init. Time
 
-    #pragma omp parallel shared(A,B,C) private(i,j,k)
+    if (reps > 0) {  // benchmark: 'warmup' untimed runs, then 'reps' timed multiplies (packing included)
+        bench_record_t rec = {"MOMP", naive ? "naive" : strassen ? "strassen" : dynamic ? "dynamic" : pack ? "packed" : "blocked",
+                              "double", size, 1, omp_get_max_threads(), warmup, reps};
+        double samples[BENCH_MAX_REPS], t;
+        double* Bp = pack && !naive && !strassen ? gemm_alloc_packed_b(size) : NULL;
+        int r;
+
+        for (r = -warmup; r < reps; r++) {
+            t = bench_now();
+            multiply_once(size, A, B, Bp, C, naive, dynamic, strassen, cutoff);
+            if (r >= 0) samples[r] = bench_now() - t;
+        }
+        bench_stats(&rec, samples, rec.threads);
+        bench_report(&rec, benchFile, json);
+        return 0;
+    }
+
+    // Density of A on sampled rows: below sparse_threshold() A is converted to CSR
+    // (instead of packing B) and multiplied with the sparse kernel
+    csr_t As;
+    if (sparse < 0)
+        sparse = !strassen && !naive && !dynamic && sparse_sample_density(size, size, A) < sparse_threshold();
+    if (sparse) {
+        csr_from_dense(&As, size, size, A);
+        if (debug) fprintf(stderr, "Sparse A: %ld nonzeros (density %.4g)\n", As.nnz, (double) As.nnz / size / size);
+    }
+
+    // Reorganize B into contiguous panels of the kernel tile width (threads pack distinct panels)
+    double* Bp = NULL;
+    if (pack && !strassen && !naive && !sparse) {
+        Bp = gemm_alloc_packed_b(size);
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < gemm_pack_b_panels(size); i++)
+            gemm_pack_b_panel(size, B, Bp, i);
+    }
+
+    packTime = my_ftime() - start_time_lt - initTime;  //-- --------- Measure packing Time
+
+    if (strassen)
+        strassen_multiply(size, A, B, C, cutoff);
+    else if (naive)
+        multiply_once(size, A, B, NULL, C, 1, 0, 0, 0);
+    else if (sparse)
+        csr_multiply(&As, B, size, C);
+    else
+    #pragma omp parallel shared(A,B,Bp,C) private(i,j,k)
     {
-        #pragma omp for schedule(static)
-        for (i = 0; i < size; i++) {
-            for (j = 0; j < size; j++) {
-                C[i * size + j] = 0;
-                for (k = 0; k < size; k++) {
-                    C[i * size + j] += A[i * size + k] * B[k * size + j];
-                }
-            }
+        if (dynamic) {
+            // gemm_mc x TILE_NB tiles of C become tasks, idle threads pick up the remaining ones
+            #pragma omp single
+            #pragma omp taskloop collapse(2) grainsize(1)
+            for (i = 0; i < size; i += gemm_mc)
+                for (j = 0; j < size; j += TILE_NB)
+                    gemm_tile(size, A, B, Bp, C, i, GEMM_MIN(i + gemm_mc, size), j, GEMM_MIN(j + TILE_NB, size));
+        } else {
+            // Each thread computes whole blocks of gemm_mc rows
+            #pragma omp for schedule(runtime)
+            for (i = 0; i < size; i += gemm_mc)
+                gemm_block_rows_ex(size, A, B, Bp, C, i, GEMM_MIN(i + gemm_mc, size));
         }
     }
 
-    compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+    compTime = my_ftime() - start_time_lt - initTime - packTime; //-- --------Measure computing Time
+    if (strassen) strassen_error_report(size, A, B, C, 64);
     if (debug) { fprintf(stderr, "A[%dx%d]:\n", size, size); display(A, size, size < 100? size:100); }
     if (debug) { fprintf(stderr, "B[%dx%d]:\n", size, size); display(B, size, size < 100? size:100); }
 
 
     // Print and stores timing results in a file
-    printf("Times (init and computing) = %.4g, %.4g sec\n\n",
-           initTime/1000.0, compTime/1000.0);
-    printf("size=%d\tinitTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, initTime/1000.0, compTime/1000.0,
+    printf("Times (init, packing and computing) = %.4g, %.4g, %.4g sec\n\n",
+           initTime/1000.0, packTime/1000.0, compTime/1000.0);
+    printf("size=%d\tinitTime=%g\tpackTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, initTime/1000.0,
+           packTime/1000.0, compTime/1000.0,
            (compTime/1000)/60, (compTime/1000)%60);
+    if (sparse) printf("sparse\tnnz=%ld\tdensity=%.4g\n", As.nnz, (double) As.nnz / size / size);
     if (debug) { fprintf(stderr, "C[%dx%d]=A*B:\n", size, size); display(C, size, size < 100? size:100);}
+    int failed = verify_product(size, A, B, C, verify, checksum);
 
     // Storage of Results and Parametres in the file resultFileName
     if (resultFileName!=NULL) {
@@ -164,5 +672,10 @@ int main (int argc, char* argv[]) {
         }
     }
     if (debug) fprintf(stderr, "Done!\n");
-    return 0;
+    matrix_free(Bp);
+    if (sparse) csr_free(&As);
+    matio_unmap(&mapA);
+    matio_unmap(&mapB);
+    matio_unmap(&mapC);  // C is written back to its file
+    return failed;
 }
\ No newline at end of file
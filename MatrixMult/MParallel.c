@@ -4,7 +4,7 @@
 //  Created 20.2.2016
 //  Modification: Jérôme Moret & Dousse Kewin 06.04.2017
 
-#define sizeMatrix 2048
+#define _GNU_SOURCE  // sched_setaffinity, CPU_SET
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,118 +14,2007 @@
 #include <sys/time.h>
 #include <limits.h>  // CLOCKS_PER_SEC
 #include <sys/timeb.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sched.h>
 #include <mpi.h>
+#include <omp.h>
+
+#include "arena.h"
+#include "gemm.h"
+#include "gemmt.h"
+#include "matio.h"
+#include "ooc.h"
+#include "batch.h"
+#include "bench.h"
+#include "perf.h"
+#include "tune.h"
+#include "verify.h"
+#include "sparse.h"
+#include "chain.h"
 
 unsigned long my_ftime() {
     struct timeval t;
 
-    gettimeofday(&t, NULL);
-    return (long) (t.tv_sec) * 1000 + (long) (t.tv_usec / 1000);
+    gettimeofday(&t, NULL);
+    return (long) (t.tv_sec) * 1000 + (long) (t.tv_usec / 1000);
+}
+
+//-- ----------------------------------------------------------------------------
+// This function unallocated the matrix (frees memory)
+double *free_real_matrix(double *matrix, int size) {
+    if (matrix == NULL) return NULL;
+
+#if 0
+    for (int i = 0; i < size; i++)
+      if (matrix[i]) {
+         free(matrix[i]);  // frees a row of the matrix
+         matrix[i] = NULL;
+      }
+#endif
+    matrix_free(matrix); // frees the pointer /
+    return NULL;        //returns a null pointer /
+}
+
+//-- ----------------------------------------------------------------------------
+// This function allocates a square matrix (see arena.h), and initializes it in parallel.
+// if 'random' is 0, initialize matrix to all 0s
+// if 'random' is -1, it initializes the matrix with random values (0->9).
+// if 'random' is -2 the matrix is initialized with no values in it.
+// else the matrix is initialized with the values of 'random' parameter.
+// The parameter 'size' defines the size of the matrix.
+double *allocate_real_matrix(int size, int random) {
+    int n = size, m = size, i, j;
+    double *matrix; //, a;     // pointer to the vector
+
+    // allocates one vector of vectors (2D array = matrix)
+    //matrix = (double**) malloc(n * sizeof(double*));
+    matrix = matrix_alloc((size_t) n * n);  // 64 bytes aligned, from the arena if it has room
+
+    if (matrix == NULL) {
+        fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+        //return (NULL);
+    }
+    if (random == 0)
+#pragma omp parallel for private(j) schedule(static)
+        for (i = 0; i < size; ++i)
+            for (j = 0; j < m; j++)
+                matrix[i * size + j] = 0;
+    else if (random == -1)
+#pragma omp parallel for private(j) schedule(static)
+        for (i = 0; i < size; ++i)
+            for (j = 0; j < m; j++)
+                matrix[i * size + j] = i + 1;// rand() % 10;  // Initialize with a random value between 0 and 9
+    else if (random != -2)
+        for (i = 0; i < size; ++i)
+            for (j = 0; j < m; j++) matrix[i * size + j] = rand() * (i + j);
+
+    return matrix;   // returns the pointer to the matrix.
+}
+
+//-- ----------------------------------------------------------------------------*/
+// Display 'size'x'size' elements of 'matrix' (of element type 'type', see gemmt.h) for debugging purposes
+void display_typed(const void *matrix, elem_t type, int size, int atmost) {
+    int i, j, limit = size < atmost ? size : atmost;
+    for (i = 0; i < limit; i++) {
+        for (j = 0; j < limit; j++)
+            fprintf(stderr, "%6.1lf ", elem_out_value(type, matrix, i * size + j));
+        //printf("%6.1lf ", (double)(*matrix+(i*size+j)));
+        if (atmost < size) fprintf(stderr, "...");
+        fprintf(stderr, "\n");
+    }
+    if (atmost < size) fprintf(stderr, "   .... .... ...\n");
+    fprintf(stderr, "\n-----------------------\n");
+}
+
+void display(double *matrix, int size, int atmost) {
+    display_typed(matrix, ELEM_F64, size, atmost);
+}
+
+// -- --------------------------------------------------------------------
+// dump the whole matrix in raw binary format - simply to allow quick compare with another result file
+void dump_typed(const void *matrix, size_t elemSize, int size, FILE *f) {
+    if (fwrite(matrix, elemSize, (size_t) size * size, f) != (size_t) size * size)
+        fprintf(stderr, "Couldn't dump results to file\n");
+}
+
+void dump(double *matrix, int size, FILE *f) {
+    dump_typed(matrix, sizeof(double), size, f);
+}
+
+//-- ----------------------------------------------------------------------------
+// Store the result in the file named after the '=' of 'resultFileName' (dump=filename)
+void save_result(double *C, int size, char *resultFileName, int debug) {
+    if (resultFileName == NULL) return;
+    ++resultFileName;      // strchr points to the '=' sign
+    if (debug) fprintf(stderr, "dumping result to %s\n", resultFileName);
+    FILE *f = fopen(resultFileName, "w");
+    if (f == NULL)
+        fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+    else {
+        dump(C, size, f);
+        fclose(f);
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// Size of the square matrix file 'path' (see matio.h), read by every rank with
+// MPI-IO. If '*size' is 0 it is set from the file, otherwise it must match.
+// Returns 0 on success.
+int mpiio_square_size(char *path, int *size, matio_header_t *hdr) {
+    MPI_File fh;
+
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        fprintf(stderr, "** Cannot read matrix file %s **\n", path);
+        return -1;
+    }
+    MPI_File_read_at_all(fh, 0, hdr, sizeof(*hdr), MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    if (matio_check_header(hdr, path) != 0) return -1;
+    if (hdr->rows != hdr->cols || (*size > 0 && hdr->rows != (uint64_t) *size)) {
+        fprintf(stderr, "** %s is not a square %dx%d matrix **\n", path, *size, *size);
+        return -1;
+    }
+    *size = (int) hdr->rows;
+    return 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Every rank reads rows 'from'..'to'-1 of the matrix file 'path' into 'rows'
+// with one collective MPI-IO call (no scatter through rank 0)
+void mpiio_read_rows(char *path, int size, int from, int to, double *rows) {
+    matio_header_t hdr;
+    MPI_File fh;
+
+    MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    MPI_File_read_at_all(fh, 0, &hdr, sizeof(hdr), MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_read_at_all(fh, hdr.data_offset + (MPI_Offset) from * size * sizeof(double), rows, (to - from) * size,
+                         MPI_DOUBLE, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+}
+
+//-- ----------------------------------------------------------------------------
+// Every rank writes its rows 'from'..'to'-1 of the 'size'x'size' matrix to the
+// file 'path' with one collective MPI-IO call; rank 0 also writes the header.
+void mpiio_write_rows(char *path, int size, int from, int to, double *rows, int taskid) {
+    matio_header_t hdr;
+    MPI_File fh;
+
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (taskid == 0) fprintf(stderr, "** Cannot create matrix file %s **\n", path);
+        return;
+    }
+    MPI_File_set_size(fh, MATIO_DATA_OFFSET + (MPI_Offset) size * size * sizeof(double));
+    if (taskid == 0) {
+        matio_make_header(&hdr, size, size);
+        MPI_File_write_at(fh, 0, &hdr, sizeof(hdr), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    MPI_File_write_at_all(fh, MATIO_DATA_OFFSET + (MPI_Offset) from * size * sizeof(double), rows, (to - from) * size,
+                          MPI_DOUBLE, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+}
+
+//-- ----------------------------------------------------------------------------
+// This function allocates a stripe of 'height' rows of a 'size'x'size' matrix,
+// without initializing it (workers only hold the rows they compute).
+double *allocate_real_stripe(int height, int size) {
+    double *stripe = matrix_alloc((size_t) height * size);
+
+    if (stripe == NULL) {
+        fprintf(stderr, "** Error in stripe creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    return stripe;
+}
+
+//-- ----------------------------------------------------------------------------
+// Collect the peak resident set size of every rank on rank 0 and print it
+// (per rank in debug mode, min/avg/max otherwise).
+void report_peak_rss(int taskid, int numtasks, int debug) {
+    struct rusage usage;
+    long rss, *all = NULL;
+    int r;
+
+    getrusage(RUSAGE_SELF, &usage);
+    rss = usage.ru_maxrss;  // kilobytes on Linux
+    if (taskid == 0) all = (long *) malloc(numtasks * sizeof(long));
+    MPI_Gather(&rss, 1, MPI_LONG, all, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    if (taskid == 0) {
+        long min = all[0], max = all[0], sum = 0;
+        for (r = 0; r < numtasks; r++) {
+            if (debug) fprintf(stderr, "rank %d peak RSS = %.1f MB\n", r, all[r] / 1024.0);
+            if (all[r] < min) min = all[r];
+            if (all[r] > max) max = all[r];
+            sum += all[r];
+        }
+        printf("peakRSS (MB) min=%.1f\tavg=%.1f\tmax=%.1f\n", min / 1024.0, sum / 1024.0 / numtasks, max / 1024.0);
+        free(all);
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// Reduce the phases of every rank to rank 0 and print, per phase, the min/avg/max
+// over the ranks of its time, counters, IPC and estimated memory bandwidth.
+// A counter that some rank could not read prints n/a.
+#define PHASE_NVALUES (PERF_NCOUNTERS + 3)   // time, counters, IPC, GB/s
+
+// Phases of the row stripe mode ('wait' is the time spent waiting for the slowest rank)
+enum { PH_ALLOC, PH_INIT, PH_BCAST, PH_SCATTER, PH_PACK, PH_COMPUTE, PH_WAIT, PH_GATHER, PH_COUNT };
+
+// At most PH_COUNT phases.
+void report_phases(perf_phase_t *ph, int n, int taskid, int numtasks) {
+    double v[PH_COUNT * PHASE_NVALUES] = {0}, min[PH_COUNT * PHASE_NVALUES], max[PH_COUNT * PHASE_NVALUES];
+    double sum[PH_COUNT * PHASE_NVALUES], total = 0;
+    int p, c;
+
+    if (n > PH_COUNT) n = PH_COUNT;
+
+    for (p = 0; p < n; p++) {
+        double *x = v + p * PHASE_NVALUES, cyc = ph[p].count[PERF_CYCLES], llc = ph[p].count[PERF_LLC_MISSES];
+        x[0] = ph[p].time;
+        for (c = 0; c < PERF_NCOUNTERS; c++)
+            x[1 + c] = perf_available ? ph[p].count[c] : -1;
+        x[PERF_NCOUNTERS + 1] = x[1] < 0 || x[2] < 0 ? -1 : (cyc > 0 ? ph[p].count[PERF_INSTRUCTIONS] / cyc : 0);
+        x[PERF_NCOUNTERS + 2] = x[4] < 0 ? -1 : (ph[p].time > 0 ? llc * 64 / ph[p].time / 1e9 : 0);
+    }
+    MPI_Reduce(v, min, n * PHASE_NVALUES, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(v, max, n * PHASE_NVALUES, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(v, sum, n * PHASE_NVALUES, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (taskid == 0) {
+        const char *names[PHASE_NVALUES] = {"time"};
+        for (c = 0; c < PERF_NCOUNTERS; c++)
+            names[1 + c] = perf_counter_names[c];
+        names[PERF_NCOUNTERS + 1] = "IPC";
+        names[PERF_NCOUNTERS + 2] = "GB/s";
+        for (p = 0; p < n; p++)
+            total += max[p * PHASE_NVALUES];
+        printf("Phases (min/avg/max over %d ranks)%s\n", numtasks,
+               perf_available ? "" : ", hardware counters not available");
+        for (p = 0; p < n; p++) {
+            int i0 = p * PHASE_NVALUES;
+            printf("phase=%s\tshare=%.1f%%", ph[p].name, total > 0 ? 100 * max[i0] / total : 0);
+            for (c = 0; c < PHASE_NVALUES; c++) {
+                if (min[i0 + c] < 0)
+                    printf("\t%s=n/a", names[c]);
+                else
+                    printf("\t%s=%.4g/%.4g/%.4g", names[c], min[i0 + c], sum[i0 + c] / numtasks, max[i0 + c]);
+            }
+            printf("\n");
+        }
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// y = M * x (and |M| * |x|) for the 'size'x'size' B held by every rank: each
+// rank computes the rows of its stripe, then the pieces are exchanged
+void verify_matvec_stripes(int size, const double *B, const double *x, double *y, double *yabs, int from, int to,
+                           int *counts, int *displs) {
+    verify_matvec(to - from, size, B + (long) from * size, x, y + from, yabs + from);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, y, counts, displs, MPI_DOUBLE, MPI_COMM_WORLD);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, yabs, counts, displs, MPI_DOUBLE, MPI_COMM_WORLD);
+}
+
+//-- ----------------------------------------------------------------------------
+// Check the row stripes of C = A * B where they were computed, without
+// gathering C: 'rounds' Freivalds rounds with random vectors shared by all
+// ranks (the largest error is reduced to rank 0), and if 'checksum' the
+// checksum of every stripe (only 3 numbers per rank reach rank 0). A and C
+// point at the stripe of the rank, rows 'from'..'to'-1.
+// Returns 1 on rank 0 if a check failed.
+int verify_stripes(int size, const double *A, const double *B, const double *C, int from, int to, int rounds,
+                   int checksum, int taskid, int numtasks) {
+    double *x = (double *) malloc(3 * (size_t) size * sizeof(double)), *y = x + size, *yabs = y + size;
+    int *counts = (int *) malloc(numtasks * sizeof(int)), *displs = (int *) malloc(numtasks * sizeof(int));
+    int bounds[2] = {from, to}, *all = (int *) malloc(2 * numtasks * sizeof(int)), failed = 0, r;
+    unsigned long seed = verify_seed();
+    double err = 0, e, sum[3], *sums = NULL;
+
+    if (x == NULL || counts == NULL || displs == NULL || all == NULL) {
+        fprintf(stderr, "** Error in verification: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Allgather(bounds, 2, MPI_INT, all, 2, MPI_INT, MPI_COMM_WORLD);
+    for (r = 0; r < numtasks; r++) {
+        displs[r] = all[2 * r];
+        counts[r] = all[2 * r + 1] - all[2 * r];
+    }
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+
+    for (r = 0; r < rounds; r++) {
+        verify_vector(x, size, seed + r);
+        verify_matvec_stripes(size, B, x, y, yabs, from, to, counts, displs);
+        e = verify_rows(to - from, size, A, C, x, y, yabs);
+        if (e > err) err = e;
+    }
+    if (rounds > 0) {
+        MPI_Reduce(taskid == 0 ? MPI_IN_PLACE : &err, &err, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (taskid == 0) failed |= verify_report_freivalds(err, size, rounds, seed);
+    }
+
+    if (checksum) {
+        for (r = 0; r < size; r++) x[r] = 1;
+        verify_matvec_stripes(size, B, x, y, yabs, from, to, counts, displs);
+        verify_checksum(to - from, size, A, C, y, yabs, sum);
+        if (taskid == 0) sums = (double *) malloc(3 * numtasks * sizeof(double));
+        MPI_Gather(sum, 3, MPI_DOUBLE, sums, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        if (taskid == 0) {
+            double total[3] = {0, 0, 0};
+            for (r = 0; r < numtasks; r++) {
+                failed |= verify_report_checksum(sums + 3 * r, size, displs[r], displs[r] + counts[r]);
+                total[0] += sums[3 * r];
+                total[1] += sums[3 * r + 1];
+                total[2] += sums[3 * r + 2];
+            }
+            if (numtasks > 1) failed |= verify_report_checksum(total, size, 0, size);
+            free(sums);
+        }
+    }
+    free(x);
+    free(counts);
+    free(displs);
+    free(all);
+    return failed;
+}
+
+//-- ----------------------------------------------------------------------------
+// First index of block 'idx' when 'n' items are split into 'p' nearly equal blocks
+int block_low(int idx, int p, int n) {
+    return idx * (n / p) + (idx < n % p ? idx : n % p);
+}
+
+// Index of the block holding item 'g'
+int block_owner(int g, int p, int n) {
+    int idx = p - 1;
+    while (block_low(idx, p, n) > g) idx--;
+    return idx;
+}
+
+//-- ----------------------------------------------------------------------------
+// Ranks of one host (shared option): they share B through MPI-3 shared memory
+// windows, and only the node leaders (node rank 0) take part in the broadcast
+typedef struct {
+    MPI_Comm node;      // ranks of this host
+    MPI_Comm leaders;   // the node leaders (MPI_COMM_NULL on the other ranks)
+    int noderank, nodesize;
+} node_comms_t;
+
+void node_split(node_comms_t *nc, int taskid) {
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, taskid, MPI_INFO_NULL, &nc->node);
+    MPI_Comm_rank(nc->node, &nc->noderank);
+    MPI_Comm_size(nc->node, &nc->nodesize);
+    MPI_Comm_split(MPI_COMM_WORLD, nc->noderank == 0 ? 0 : MPI_UNDEFINED, taskid, &nc->leaders);
+}
+
+void node_free(node_comms_t *nc) {
+    if (nc->leaders != MPI_COMM_NULL) MPI_Comm_free(&nc->leaders);
+    MPI_Comm_free(&nc->node);
+}
+
+// 'count' doubles allocated once per host by the node leader and mapped by
+// every rank of the node. Collective over the node; release with MPI_Win_free.
+double *node_shared_alloc(node_comms_t *nc, size_t count, MPI_Win *win) {
+    MPI_Aint bytes;
+    double *base;
+    int disp;
+
+    if (MPI_Win_allocate_shared(nc->noderank == 0 ? (MPI_Aint) (count * sizeof(double)) : 0, sizeof(double),
+                                MPI_INFO_NULL, nc->node, &base, win) != MPI_SUCCESS) {
+        fprintf(stderr, "** Error in shared matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Win_shared_query(*win, 0, &bytes, &disp, &base);
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, *win);
+    return base;
+}
+
+#define SUMMA_KB 256    // width of the panels broadcast at each SUMMA step
+
+//-- ----------------------------------------------------------------------------
+// SUMMA multiplication on a 2D process grid. Rank (r,c) owns block (r,c) of A,
+// B and C and initializes it itself; at each step the owners broadcast a
+// panel of A along their row communicator and a panel of B along their column
+// communicator, and every rank accumulates panelA * panelB into its C block.
+// Per-rank memory is about 3*size^2/P. C is only gathered on rank 0 for
+// 'dump' or 'debug'.
+void summa_multiply(int size, int debug, int rss, char *resultFileName, int taskid, int numtasks) {
+    int dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+    int myrow, mycol, pr, pc, m, n, row0, col0, i, j, k, r;
+    unsigned long start_time_lt = 0, initTime, compTime;
+    double commTime = 0, maxCommTime, t;
+    MPI_Comm grid, row_comm, col_comm;
+
+    MPI_Dims_create(numtasks, 2, dims);
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+    MPI_Cart_coords(grid, taskid, 2, coords);
+    pr = dims[0];
+    pc = dims[1];
+    myrow = coords[0];
+    mycol = coords[1];
+    MPI_Comm_split(grid, myrow, mycol, &row_comm);  // ranks of my grid row, ranked by column
+    MPI_Comm_split(grid, mycol, myrow, &col_comm);  // ranks of my grid column, ranked by row
+
+    row0 = block_low(myrow, pr, size);
+    m = block_low(myrow + 1, pr, size) - row0;
+    col0 = block_low(mycol, pc, size);
+    n = block_low(mycol + 1, pc, size) - col0;
+
+    if (taskid == 0 && debug)
+        fprintf(stderr, "\nStart SUMMA algorithm on a %dx%d grid (size=%d)...\n", pr, pc, size);
+    if (taskid == 0)
+        start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
+
+    // Local blocks, initialized as allocate_real_matrix(size, -1) would (A[i][j] = i+1)
+    double *A = matrix_alloc((size_t) m * n);
+    double *B = matrix_alloc((size_t) m * n);
+    double *C = matrix_alloc((size_t) m * n);
+    double *Apanel = matrix_alloc((size_t) m * SUMMA_KB);
+    double *Bpanel = matrix_alloc((size_t) SUMMA_KB * n);
+    if (A == NULL || B == NULL || C == NULL || Apanel == NULL || Bpanel == NULL) {
+        fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < m; i++)
+        for (j = 0; j < n; j++) {
+            A[(long) i * n + j] = row0 + i + 1;
+            B[(long) i * n + j] = row0 + i + 1;
+            C[(long) i * n + j] = 0;
+        }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (taskid == 0)
+        initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
+
+    for (k = 0; k < size; k += r) {
+        // The panel stops at the end of the column block of A and of the row block of B
+        int ownA = block_owner(k, pc, size), ownB = block_owner(k, pr, size);
+        int endA = block_low(ownA + 1, pc, size), endB = block_low(ownB + 1, pr, size);
+        int kb = GEMM_MIN(SUMMA_KB, GEMM_MIN(endA, endB) - k);
+        double *bp;
+
+        if (mycol == ownA)
+            for (i = 0; i < m; i++)
+                memcpy(Apanel + (long) i * kb, A + (long) i * n + (k - col0), kb * sizeof(double));
+        bp = (myrow == ownB) ? B + (long) (k - row0) * n : Bpanel;  // rows of B are already contiguous
+
+        t = MPI_Wtime();
+        MPI_Bcast(Apanel, m * kb, MPI_DOUBLE, ownA, row_comm);
+        MPI_Bcast(bp, kb * n, MPI_DOUBLE, ownB, col_comm);
+        commTime += MPI_Wtime() - t;
+
+#pragma omp parallel for schedule(static)
+        for (i = 0; i < m; i += gemm_mc)
+            gemm_blocked(GEMM_MIN(gemm_mc, m - i), n, kb, Apanel + (long) i * kb, kb, bp, n, NULL,
+                         C + (long) i * n, n);
+        r = kb;
+    }
+
+    MPI_Reduce(&commTime, &maxCommTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (taskid == 0) {
+        compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+        printf("Times (init, send and computing) = %.4g, %.4g, %.4g sec\n\n", initTime / 1000.0, maxCommTime,
+               compTime / 1000.0);
+        printf("size=%d\tgrid=%dx%d\tinitTime=%g\tsendTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, pr, pc,
+               initTime / 1000.0, maxCommTime, compTime / 1000.0, (compTime / 1000) / 60, (compTime / 1000) % 60);
+    }
+
+    // Gather the blocks of C on rank 0, only when the full result is wanted
+    if (resultFileName != NULL || debug) {
+        if (taskid == 0) {
+            double *full = allocate_real_matrix(size, -2);
+            for (r = 0; r < numtasks; r++) {
+                int rc[2], rm, rn, rrow0, rcol0;
+                MPI_Datatype block;
+                MPI_Cart_coords(grid, r, 2, rc);
+                rrow0 = block_low(rc[0], pr, size);
+                rm = block_low(rc[0] + 1, pr, size) - rrow0;
+                rcol0 = block_low(rc[1], pc, size);
+                rn = block_low(rc[1] + 1, pc, size) - rcol0;
+                MPI_Type_vector(rm, rn, size, MPI_DOUBLE, &block);
+                MPI_Type_commit(&block);
+                if (r == 0)
+                    MPI_Sendrecv(C, m * n, MPI_DOUBLE, 0, 0, full + (long) rrow0 * size + rcol0, 1, block, 0, 0,
+                                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                else
+                    MPI_Recv(full + (long) rrow0 * size + rcol0, 1, block, r, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                MPI_Type_free(&block);
+            }
+            if (debug) {
+                fprintf(stderr, "C[%dx%d]=A*B:\n", size, size);
+                display(full, size, size < 100 ? size : 100);
+            }
+            save_result(full, size, resultFileName, debug);
+            free_real_matrix(full, size);
+        } else
+            MPI_Send(C, m * n, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD);
+    }
+
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+
+    matrix_free(A);
+    matrix_free(B);
+    matrix_free(C);
+    matrix_free(Apanel);
+    matrix_free(Bpanel);
+    MPI_Comm_free(&row_comm);
+    MPI_Comm_free(&col_comm);
+    MPI_Comm_free(&grid);
+}
+
+#define PIPE_KB 256     // rows of B per non-blocking broadcast
+#define PIPE_NB 512     // columns of C per compute tile
+#define PIPE_RB 384     // rows of C sent back to rank 0 at once
+
+//-- ----------------------------------------------------------------------------
+// Row stripes with communication overlapped by computation. B is broadcast in
+// chunks of PIPE_KB rows with MPI_Ibcast and the stripes of A with
+// MPI_Iscatterv; each rank multiplies its stripe by a chunk of B as soon as
+// it has arrived while the next chunks are still in flight. During the last
+// chunk, groups of PIPE_RB rows of C are sent back to rank 0 as soon as they
+// are finished. sendTime is the time the slowest rank spent waiting.
+void pipeline_multiply(int size, int debug, int rss, char *resultFileName, int taskid, int numtasks) {
+    int stripe_height = size / numtasks, extra_stripe_height = size % numtasks;
+    int from = taskid * stripe_height;
+    int to = (taskid + 1) * stripe_height + (taskid == numtasks - 1 ? extra_stripe_height : 0);
+    int rows = to - from, nchunks = (size + PIPE_KB - 1) / PIPE_KB;
+    int c, g, i, j, r, ncreq = 0, flag;
+    unsigned long start_time_lt = 0, initTime = 0, compTime = 0;
+    double waitTime = 0, maxWaitTime, t;
+    double *A, *B, *C;
+
+    if (taskid == 0 && debug) fprintf(stderr, "\nStart pipelined MPI/OpenMP algorithm (size=%d)...\n", size);
+    if (taskid == 0)
+        start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
+
+    if (taskid == 0) {
+        A = allocate_real_matrix(size, -1);
+        B = allocate_real_matrix(size, -1);
+        C = allocate_real_matrix(size, -2);
+    } else {
+        A = allocate_real_stripe(rows, size);
+        B = allocate_real_matrix(size, -2);
+        C = allocate_real_stripe(rows, size);
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < rows; i++)
+        memset(C + (long) i * size, 0, size * sizeof(double));
+
+    int *displs = (int *) malloc(numtasks * sizeof(int));
+    int *scounts = (int *) malloc(numtasks * sizeof(int));
+    for (r = 0; r < numtasks; r++) {
+        displs[r] = r * stripe_height * size;
+        scounts[r] = (stripe_height + (r == numtasks - 1 ? extra_stripe_height : 0)) * size;
+    }
+
+    if (taskid == 0)
+        initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
+
+    // Post every transfer at once; they progress while we compute
+    MPI_Request areq, *breq = (MPI_Request *) malloc(nchunks * sizeof(MPI_Request));
+    MPI_Request *creq = (MPI_Request *) malloc((size / PIPE_RB + numtasks) * sizeof(MPI_Request));
+    MPI_Iscatterv(A, scounts, displs, MPI_DOUBLE, taskid == 0 ? MPI_IN_PLACE : A, rows * size, MPI_DOUBLE, 0,
+                  MPI_COMM_WORLD, &areq);
+    for (c = 0; c < nchunks; c++) {
+        int k0 = c * PIPE_KB, kb = GEMM_MIN(PIPE_KB, size - k0);
+        MPI_Ibcast(B + (long) k0 * size, kb * size, MPI_DOUBLE, 0, MPI_COMM_WORLD, &breq[c]);
+    }
+    if (taskid == 0)  // rank 0 receives the groups of rows of C of the other ranks
+        for (r = 1; r < numtasks; r++) {
+            int rfrom = displs[r] / size, rrows = scounts[r] / size;
+            for (g = 0; g < rrows; g += PIPE_RB)
+                MPI_Irecv(C + (long) (rfrom + g) * size, GEMM_MIN(PIPE_RB, rrows - g) * size, MPI_DOUBLE, r,
+                          g / PIPE_RB, MPI_COMM_WORLD, &creq[ncreq++]);
+        }
+
+    t = MPI_Wtime();
+    MPI_Wait(&areq, MPI_STATUS_IGNORE);
+    waitTime += MPI_Wtime() - t;
+
+    for (c = 0; c < nchunks; c++) {
+        int k0 = c * PIPE_KB, kb = GEMM_MIN(PIPE_KB, size - k0), last = (c == nchunks - 1);
+        int grows = last ? PIPE_RB : rows;  // the last chunk is computed group by group
+
+        t = MPI_Wtime();
+        MPI_Wait(&breq[c], MPI_STATUS_IGNORE);
+        waitTime += MPI_Wtime() - t;
+
+        for (g = 0; g < rows; g += grows) {
+            int gend = GEMM_MIN(g + grows, rows);
+#pragma omp parallel for collapse(2) schedule(static)
+            for (i = g; i < gend; i += gemm_mc)
+                for (j = 0; j < size; j += PIPE_NB)
+                    gemm_blocked(GEMM_MIN(gemm_mc, gend - i), GEMM_MIN(PIPE_NB, size - j), kb,
+                                 A + (long) i * size + k0, size, B + (long) k0 * size + j, size, NULL,
+                                 C + (long) i * size + j, size);
+            if (last && taskid != 0)
+                MPI_Isend(C + (long) g * size, (gend - g) * size, MPI_DOUBLE, 0, g / PIPE_RB, MPI_COMM_WORLD,
+                          &creq[ncreq++]);
+        }
+        // Give the MPI library a chance to progress the pending chunks
+        if (!last) MPI_Testall(nchunks - c - 1, breq + c + 1, &flag, MPI_STATUSES_IGNORE);
+    }
+
+    t = MPI_Wtime();
+    MPI_Waitall(ncreq, creq, MPI_STATUSES_IGNORE);
+    waitTime += MPI_Wtime() - t;
+
+    MPI_Reduce(&waitTime, &maxWaitTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (taskid == 0) {
+        compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+        printf("Times (init, send and computing) = %.4g, %.4g, %.4g sec\n\n", initTime / 1000.0, maxWaitTime,
+               compTime / 1000.0);
+        printf("size=%d\tinitTime=%g\tsendTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, initTime / 1000.0,
+               maxWaitTime, compTime / 1000.0, (compTime / 1000) / 60, (compTime / 1000) % 60);
+        if (debug) {
+            fprintf(stderr, "C[%dx%d]=A*B:\n", size, size);
+            display(C, size, size < 100 ? size : 100);
+        }
+        save_result(C, size, resultFileName, debug);
+    }
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+
+    matrix_free(A);
+    matrix_free(B);
+    matrix_free(C);
+    free(breq);
+    free(creq);
+    free(scounts);
+    free(displs);
+}
+
+//-- ----------------------------------------------------------------------------
+// Hybrid launch: one rank per NUMA domain, e.g.
+//   mpirun --map-by ppr:1:numa --bind-to numa ./MParallel <size> hybrid
+// Pin each OpenMP thread to its own CPU of the set the rank was bound to by
+// mpirun (threads are spread round-robin if there are more threads than CPUs).
+void pin_threads(int taskid, int debug) {
+    cpu_set_t allowed;
+
+    sched_getaffinity(0, sizeof(allowed), &allowed);  // read once, before any thread is pinned
+#pragma omp parallel
+    {
+        int tid = omp_get_thread_num(), count = CPU_COUNT(&allowed), n = tid % count, cpu;
+        cpu_set_t mine;
+
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed) && n-- == 0) break;
+        CPU_ZERO(&mine);
+        CPU_SET(cpu, &mine);
+        sched_setaffinity(0, sizeof(mine), &mine);
+        if (debug) fprintf(stderr, "rank %d thread %d pinned to cpu %d\n", taskid, tid, sched_getcpu());
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// First touch of 'rows' rows of a matrix with the same static schedule over
+// blocks of gemm_mc rows as the compute loop, so that each page lands in the
+// NUMA domain of the thread that will use it. If 'fill' is set the rows are
+// initialized as allocate_real_matrix(size, -1) does, otherwise to 0.
+void first_touch_rows(double *matrix, int rows, int size, int fill) {
+    int i, r, j;
+
+#pragma omp parallel for private(r,j) schedule(static)
+    for (i = 0; i < rows; i += gemm_mc)
+        for (r = i; r < GEMM_MIN(i + gemm_mc, rows); r++)
+            for (j = 0; j < size; j++)
+                matrix[(long) r * size + j] = fill ? r + 1 : 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Print on rank 0 the min/avg/max of the compute time of the threads of every
+// rank, and the time of every thread in debug mode.
+void report_thread_times(double *threadTime, int nthreads, int taskid, int numtasks, int debug) {
+    double stats[4] = {nthreads, threadTime[0], 0, threadTime[0]}, *all = NULL;
+    int t, r;
+
+    for (t = 0; t < nthreads; t++) {
+        if (debug) fprintf(stderr, "rank %d thread %d computeTime=%g\n", taskid, t, threadTime[t]);
+        if (threadTime[t] < stats[1]) stats[1] = threadTime[t];
+        if (threadTime[t] > stats[3]) stats[3] = threadTime[t];
+        stats[2] += threadTime[t] / nthreads;
+    }
+    if (taskid == 0) all = (double *) malloc(4 * numtasks * sizeof(double));
+    MPI_Gather(stats, 4, MPI_DOUBLE, all, 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (taskid == 0) {
+        for (r = 0; r < numtasks; r++)
+            printf("rank %d: %d threads\tcomputeTime min=%g\tavg=%g\tmax=%g\t(imbalance %.1f%%)\n", r,
+                   (int) all[4 * r], all[4 * r + 1], all[4 * r + 2], all[4 * r + 3],
+                   all[4 * r + 2] > 0 ? 100.0 * (all[4 * r + 3] / all[4 * r + 2] - 1) : 0.0);
+        free(all);
+    }
+}
+
+#define DYN_ROWS 32     // rows of C per tile handed out by rank 0
+#define DYN_NB 512      // columns of C per OpenMP task inside a tile
+#define TAG_REQ 1       // worker -> rank 0: id of the finished tile (-1 at start)
+#define TAG_C 2         // worker -> rank 0: rows of C of the finished tile
+#define TAG_WORK 3      // rank 0 -> worker: id of the next tile (-1: no more work)
+#define TAG_A 4         // rank 0 -> worker: rows of A of the next tile
+
+//-- ----------------------------------------------------------------------------
+// Compute the tile rows 'i0'..'i1'-1 of C with OpenMP tasks of DYN_NB columns,
+// so idle threads pick up the remaining work.
+void compute_tile_tasks(int size, double *A, double *B, double *Bp, double *C, int i0, int i1) {
+    int j;
+
+#pragma omp parallel
+#pragma omp single
+#pragma omp taskloop grainsize(1)
+    for (j = 0; j < size; j += DYN_NB)
+        gemm_tile(size, A, B, Bp, C, i0, i1, j, GEMM_MIN(j + DYN_NB, size));
+}
+
+//-- ----------------------------------------------------------------------------
+// Dynamic master/worker scheduling for heterogeneous nodes. B is broadcast;
+// C is cut into tiles of DYN_ROWS rows that rank 0 hands out on request,
+// together with the matching rows of A. A worker returns its finished tile
+// with the request for the next one, so fast nodes simply take more tiles.
+// On rank 0 thread 0 serves the requests while the other threads compute
+// tiles themselves (with a single thread it alternates between the two).
+// Each rank reports its number of tiles and its utilization (busy / wall).
+void dynamic_multiply(int size, int debug, int rss, int pack, char *resultFileName, int taskid, int numtasks) {
+    int ntiles = (size + DYN_ROWS - 1) / DYN_ROWS, nthreads = omp_get_max_threads(), i, r;
+    int next = 0, mytiles = 0;
+    unsigned long start_time_lt = 0, initTime, compTime;
+    double busy = 0, wall, start, stats[3], *all = NULL;
+    double *A, *B, *C, *Bp = NULL;
+
+    if (taskid == 0 && debug) fprintf(stderr, "\nStart dynamic MPI/OpenMP algorithm (size=%d, %d tiles)...\n", size, ntiles);
+    if (taskid == 0)
+        start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
+
+    if (taskid == 0) {
+        A = allocate_real_matrix(size, -1);
+        B = allocate_real_matrix(size, -1);
+        C = allocate_real_matrix(size, -2);
+    } else { // one tile of A and C at a time
+        A = allocate_real_stripe(DYN_ROWS, size);
+        B = allocate_real_matrix(size, -2);
+        C = allocate_real_stripe(DYN_ROWS, size);
+    }
+    MPI_Bcast(B, size * size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (pack) {
+        Bp = gemm_alloc_packed_b(size);
+#pragma omp parallel for schedule(static)
+        for (i = 0; i < gemm_pack_b_panels(size); i++)
+            gemm_pack_b_panel(size, B, Bp, i);
+    }
+
+    if (taskid == 0)
+        initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    if (taskid == 0) {
+        int active = numtasks - 1;
+#pragma omp parallel reduction(+:busy,mytiles)
+        {
+            int tile, done, flag;
+            double t;
+            MPI_Status st;
+
+            if (omp_get_thread_num() == 0) { // only the master thread talks to MPI (MPI_THREAD_FUNNELED)
+                while (active > 0) {
+                    if (nthreads > 1)
+                        MPI_Probe(MPI_ANY_SOURCE, TAG_REQ, MPI_COMM_WORLD, &st);
+                    else
+                        MPI_Iprobe(MPI_ANY_SOURCE, TAG_REQ, MPI_COMM_WORLD, &flag, &st);
+                    if (nthreads > 1 || flag) {
+                        MPI_Recv(&done, 1, MPI_INT, st.MPI_SOURCE, TAG_REQ, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                        if (done >= 0)
+                            MPI_Recv(C + (long) done * DYN_ROWS * size,
+                                     (GEMM_MIN((done + 1) * DYN_ROWS, size) - done * DYN_ROWS) * size, MPI_DOUBLE,
+                                     st.MPI_SOURCE, TAG_C, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+#pragma omp atomic capture
+                        tile = next++;
+                        if (tile >= ntiles) {
+                            tile = -1;
+                            active--;
+                        }
+                        MPI_Send(&tile, 1, MPI_INT, st.MPI_SOURCE, TAG_WORK, MPI_COMM_WORLD);
+                        if (tile >= 0)
+                            MPI_Send(A + (long) tile * DYN_ROWS * size,
+                                     (GEMM_MIN((tile + 1) * DYN_ROWS, size) - tile * DYN_ROWS) * size, MPI_DOUBLE,
+                                     st.MPI_SOURCE, TAG_A, MPI_COMM_WORLD);
+                        continue;
+                    }
+                    // single thread and nobody waiting: compute one tile ourselves
+#pragma omp atomic capture
+                    tile = next++;
+                    if (tile < ntiles) {
+                        t = omp_get_wtime();
+                        gemm_tile(size, A, B, Bp, C, tile * DYN_ROWS, GEMM_MIN((tile + 1) * DYN_ROWS, size), 0, size);
+                        busy += omp_get_wtime() - t;
+                        mytiles++;
+                    }
+                }
+            }
+            if (omp_get_thread_num() != 0 || nthreads == 1)
+                for (;;) {
+#pragma omp atomic capture
+                    tile = next++;
+                    if (tile >= ntiles) break;
+                    t = omp_get_wtime();
+                    gemm_tile(size, A, B, Bp, C, tile * DYN_ROWS, GEMM_MIN((tile + 1) * DYN_ROWS, size), 0, size);
+                    busy += omp_get_wtime() - t;
+                    mytiles++;
+                }
+        }
+        busy /= nthreads > 1 ? nthreads - 1 : 1;  // average over the computing threads
+    } else {
+        int tile = -1, rows = 0;
+        double t;
+
+        for (;;) {
+            MPI_Send(&tile, 1, MPI_INT, 0, TAG_REQ, MPI_COMM_WORLD);
+            if (tile >= 0)
+                MPI_Send(C, rows * size, MPI_DOUBLE, 0, TAG_C, MPI_COMM_WORLD);
+            MPI_Recv(&tile, 1, MPI_INT, 0, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (tile < 0) break;
+            rows = GEMM_MIN((tile + 1) * DYN_ROWS, size) - tile * DYN_ROWS;
+            MPI_Recv(A, rows * size, MPI_DOUBLE, 0, TAG_A, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            t = omp_get_wtime();
+            compute_tile_tasks(size, A, B, Bp, C, 0, rows);
+            busy += omp_get_wtime() - t;
+            mytiles++;
+        }
+    }
+    wall = MPI_Wtime() - start;
+
+    // Utilization report: tiles, busy time and busy / wall of every rank
+    stats[0] = mytiles;
+    stats[1] = busy;
+    stats[2] = wall;
+    if (taskid == 0) all = (double *) malloc(3 * numtasks * sizeof(double));
+    MPI_Gather(stats, 3, MPI_DOUBLE, all, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (taskid == 0) {
+        compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+        printf("Times (init and computing) = %.4g, %.4g sec\n\n", initTime / 1000.0, compTime / 1000.0);
+        printf("size=%d\tinitTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, initTime / 1000.0,
+               compTime / 1000.0, (compTime / 1000) / 60, (compTime / 1000) % 60);
+        for (r = 0; r < numtasks; r++)
+            printf("rank %d: tiles=%d\tbusy=%g\twall=%g\tutilization=%.1f%%\n", r, (int) all[3 * r], all[3 * r + 1],
+                   all[3 * r + 2], all[3 * r + 2] > 0 ? 100.0 * all[3 * r + 1] / all[3 * r + 2] : 0.0);
+        free(all);
+        if (debug) {
+            fprintf(stderr, "C[%dx%d]=A*B:\n", size, size);
+            display(C, size, size < 100 ? size : 100);
+        }
+        save_result(C, size, resultFileName, debug);
+    }
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+
+    matrix_free(A);
+    matrix_free(B);
+    matrix_free(C);
+    matrix_free(Bp);
+}
+
+//-- ----------------------------------------------------------------------------
+// Out-of-core multiplication (see ooc.h): every rank streams the tiles of its
+// block of rows of C from the files A and B and writes them to the file C,
+// holding at most about 'memMB' MB. Rank 0 reports the slowest rank's times
+// and the total I/O volume.
+void ooc_parallel_multiply(int size, int debug, int rss, int memMB, char *fileA, char *fileB, char *fileC,
+                           int taskid, int numtasks) {
+    int from = block_low(taskid, numtasks, size), to = block_low(taskid + 1, numtasks, size), err = 0, anyErr;
+    double start, mine[4], max[4], sum[4];
+    ooc_stats_t st = {0};
+
+    if (taskid == 0 && debug) fprintf(stderr, "\nStart out-of-core MPI/OpenMP algorithm (size=%d)...\n", size);
+    if (taskid == 0) err = ooc_create(fileC, size) != 0;
+    MPI_Bcast(&err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (err) MPI_Abort(MPI_COMM_WORLD, 1);
+
+    start = MPI_Wtime();
+    err = ooc_multiply(fileA, fileB, fileC, size, from, to, (size_t) memMB << 20, debug && taskid == 0, &st) != 0;
+    mine[0] = MPI_Wtime() - start;
+    mine[1] = st.waitTime;
+    mine[2] = st.readBytes;
+    mine[3] = st.writeBytes;
+    MPI_Allreduce(&err, &anyErr, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Reduce(mine, max, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(mine, sum, 4, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (anyErr) MPI_Abort(MPI_COMM_WORLD, 1);
+    if (taskid == 0)
+        printf("size=%d\tcomputeTime=%g\ttile=%dx%d\treadMB=%.0f\twriteMB=%.0f\tmaxWaitTime=%g\n", size, max[0],
+               st.tile, st.depth, sum[2] / 1048576, sum[3] / 1048576, max[1]);
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+}
+
+//-- ----------------------------------------------------------------------------
+// MPI datatype of the elements of A and B ('result' = 0) or of C ('result' = 1)
+MPI_Datatype elem_mpi_type(elem_t type, int result) {
+    if (type == ELEM_F32 || (type == ELEM_MIXED && !result)) return MPI_FLOAT;
+    if (type == ELEM_I32) return MPI_INT32_T;
+    return MPI_DOUBLE;
+}
+
+//-- ----------------------------------------------------------------------------
+// Row stripe multiplication for an element type other than double (see
+// gemmt.h): the same scatter / broadcast / gather as the default mode, with
+// the MPI datatype of the elements, so float halves the volume sent.
+void typed_stripe_multiply(int size, elem_t type, int debug, int rss, char *resultFileName, int taskid,
+                           int numtasks) {
+    int from = block_low(taskid, numtasks, size), to = block_low(taskid + 1, numtasks, size), i;
+    size_t in = elem_in_size(type), out = elem_out_size(type);
+    MPI_Datatype tin = elem_mpi_type(type, 0), tout = elem_mpi_type(type, 1);
+    unsigned long start_time_lt = 0, initTime, sendTime, packTime, compTime;
+    int *displs = (int *) malloc(numtasks * sizeof(int)), *counts = (int *) malloc(numtasks * sizeof(int));
+    void *A, *B, *C, *Bp;
+
+    if (taskid == 0 && debug) fprintf(stderr, "\nStart parallel MPI/OpenMP algorithm (size=%d, type=%s)...\n", size,
+                                      elem_names[type]);
+    if (taskid == 0)
+        start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
+
+    // Rank 0 holds the whole A and C, the workers their stripe
+    A = elem_alloc((size_t) (taskid == 0 ? size : to - from) * size, in);
+    B = elem_alloc((size_t) size * size, in);
+    C = elem_alloc((size_t) (taskid == 0 ? size : to - from) * size, out);
+    Bp = elem_alloc(elem_packed_size(type, size), in);
+    if (A == NULL || B == NULL || C == NULL || Bp == NULL) {
+        fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (taskid == 0) {
+        elem_fill(type, A, size, 0, size);
+        elem_fill(type, B, size, 0, size);
+    }
+    for (i = 0; i < numtasks; i++) {
+        displs[i] = block_low(i, numtasks, size) * size;
+        counts[i] = block_low(i + 1, numtasks, size) * size - displs[i];
+    }
+
+    if (taskid == 0)
+        initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
+
+    MPI_Bcast(B, size * size, tin, 0, MPI_COMM_WORLD);
+    if (taskid == 0)
+        MPI_Scatterv(A, counts, displs, tin, MPI_IN_PLACE, counts[0], tin, 0, MPI_COMM_WORLD);
+    else
+        MPI_Scatterv(NULL, counts, displs, tin, A, counts[taskid], tin, 0, MPI_COMM_WORLD);
+
+    if (taskid == 0)
+        sendTime = my_ftime() - start_time_lt;  //-- ----------------- Measure send. Time
+
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < elem_pack_panels(type, size); i++)
+        elem_pack_panel(type, size, B, Bp, i);
+
+    if (taskid == 0)
+        packTime = my_ftime() - start_time_lt - sendTime;  //-- --------- Measure packing Time
+
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < to - from; i += gemm_mc)
+        elem_rows(type, size, (char *) A + (size_t) i * size * in, Bp, (char *) C + (size_t) i * size * out,
+                  from + i, from + GEMM_MIN(i + gemm_mc, to - from));
+
+    if (taskid == 0)
+        MPI_Gatherv(MPI_IN_PLACE, counts[0], tout, C, counts, displs, tout, 0, MPI_COMM_WORLD);
+    else
+        MPI_Gatherv(C, counts[taskid], tout, NULL, counts, displs, tout, 0, MPI_COMM_WORLD);
+
+    if (taskid == 0) {
+        compTime = my_ftime() - start_time_lt - initTime - packTime; //-- --------Measure computing Time
+        printf("Times (init, send, packing and computing) = %.4g, %.4g, %.4g, %.4g sec\n\n", initTime / 1000.0,
+               sendTime / 1000.0, packTime / 1000.0, compTime / 1000.0);
+        printf("size=%d\ttype=%s\tinitTime=%g\tsendTime=%g\tpackTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size,
+               elem_names[type], initTime / 1000.0, sendTime / 1000.0, packTime / 1000.0, compTime / 1000.0,
+               (compTime / 1000) / 60, (compTime / 1000) % 60);
+        if (debug) {
+            fprintf(stderr, "C[%dx%d]=A*B:\n", size, size);
+            display_typed(C, type, size, size < 100 ? size : 100);
+        }
+        if (resultFileName != NULL) {
+            FILE *f = fopen(resultFileName + 1, "w");  // strchr points to the '=' sign
+            if (f == NULL)
+                fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+            else {
+                dump_typed(C, out, size, f);
+                fclose(f);
+            }
+        }
+    }
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+
+    matrix_free(A);
+    matrix_free(B);
+    matrix_free(C);
+    matrix_free(Bp);
+    free(displs);
+    free(counts);
+}
+
+//-- ----------------------------------------------------------------------------
+// Density of the matrix file 'path' on (at most) SPARSE_SAMPLE_ROWS rows read
+// by rank 0 (see sparse_sample_density), known by every rank on return
+double mpiio_sample_density(char *path, int size, int taskid) {
+    double density = 0;
+
+    if (taskid == 0) {
+        int samples = GEMM_MIN(size, SPARSE_SAMPLE_ROWS), s;
+        double *rows = (double *) malloc((size_t) samples * size * sizeof(double));
+        matio_header_t hdr;
+        MPI_File fh;
+        if (rows == NULL) {
+            fprintf(stderr, "** Error in density sampling: insufficient memory **");
+            fprintf(stderr, "** Program aborted................................ **");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        MPI_File_open(MPI_COMM_SELF, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+        MPI_File_read_at(fh, 0, &hdr, sizeof(hdr), MPI_BYTE, MPI_STATUS_IGNORE);
+        for (s = 0; s < samples; s++)
+            MPI_File_read_at(fh, hdr.data_offset + (MPI_Offset) ((long) s * size / samples) * size * sizeof(double),
+                             rows + (long) s * size, size, MPI_DOUBLE, MPI_STATUS_IGNORE);
+        MPI_File_close(&fh);
+        density = sparse_sample_density(samples, size, rows);
+        free(rows);
+    }
+    MPI_Bcast(&density, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    return density;
+}
+
+//-- ----------------------------------------------------------------------------
+// Dense copy of the CSR 'a' into the 'a->rows'x'a->cols' M (the stripe
+// of A that the checks need)
+void csr_to_dense(const csr_t *a, double *M) {
+    int i;
+    long p;
+
+#pragma omp parallel for private(p) schedule(static)
+    for (i = 0; i < a->rows; i++) {
+        double *m = M + (long) i * a->cols;
+        memset(m, 0, a->cols * sizeof(double));
+        for (p = a->rowptr[i]; p < a->rowptr[i + 1]; p++)
+            m[a->col[p]] = a->val[p];
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// Row stripe multiplication of a sparse A (see sparse.h): the stripes hold the
+// same number of nonzeros of A rather than the same number of rows, and go to
+// the workers in CSR. A generated A ('density' of its elements kept) is
+// converted and partitioned by rank 0 and its stripes scattered; with a file
+// every rank counts the nonzeros of an equal stripe, the counts are shared
+// and each rank reads and converts its balanced stripe. B is broadcast whole.
+// Returns 1 on rank 0 if a verification failed.
+int sparse_stripe_multiply(int size, double density, int debug, int rss, int verify, int checksum,
+                           char *resultFileName, char *fileA, char *fileB, char *fileC, int taskid, int numtasks) {
+    int *bounds = (int *) malloc((numtasks + 1) * sizeof(int)), *counts = (int *) malloc(numtasks * sizeof(int));
+    int *displs = (int *) malloc(numtasks * sizeof(int)), from, to, r, failed = 0;
+    long *cuts = (long *) malloc((numtasks + 1) * sizeof(long)), nnz, maxNnz;
+    unsigned long start_time_lt = 0, initTime = 0, sendTime = 0, compTime = 0, gatherTime = 0;
+    double *A = NULL, *B, *C;
+    csr_t full, a;
+
+    if (taskid == 0 && debug) fprintf(stderr, "\nStart sparse MPI/OpenMP algorithm (size=%d)...\n", size);
+    if (taskid == 0)
+        start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
+
+    // Nonzero balanced bounds of the stripes, and the first nonzero of each stripe
+    if (fileA == NULL) {
+        if (taskid == 0) {
+            A = allocate_real_matrix(size, -1);
+            sparse_thin(A, size, size, 0, density);
+            csr_from_dense(&full, size, size, A);
+            csr_partition(full.rowptr, size, numtasks, bounds);
+            for (r = 0; r <= numtasks; r++)
+                cuts[r] = full.rowptr[bounds[r]];
+        }
+        MPI_Bcast(bounds, numtasks + 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Bcast(cuts, numtasks + 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    } else {
+        long *count = (long *) malloc(size * sizeof(long)), *rowptr = (long *) malloc((size + 1) * sizeof(long));
+        double *rows;
+        int i, j;
+        from = block_low(taskid, numtasks, size);
+        to = block_low(taskid + 1, numtasks, size);
+        rows = allocate_real_stripe(to - from, size);
+        mpiio_read_rows(fileA, size, from, to, rows);
+#pragma omp parallel for private(j) schedule(static)
+        for (i = from; i < to; i++) {
+            long c = 0;
+            for (j = 0; j < size; j++)
+                c += rows[(long) (i - from) * size + j] != 0;
+            count[i] = c;
+        }
+        matrix_free(rows);
+        for (r = 0; r < numtasks; r++) {
+            displs[r] = block_low(r, numtasks, size);
+            counts[r] = block_low(r + 1, numtasks, size) - displs[r];
+        }
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_LONG, count, counts, displs, MPI_LONG, MPI_COMM_WORLD);
+        csr_rowptr(rowptr, count, size);
+        csr_partition(rowptr, size, numtasks, bounds);
+        for (r = 0; r <= numtasks; r++)
+            cuts[r] = rowptr[bounds[r]];
+        free(count);
+        free(rowptr);
+    }
+    from = bounds[taskid];
+    to = bounds[taskid + 1];
+    nnz = cuts[taskid + 1] - cuts[taskid];
+
+    // Rank 0 holds the whole C, the workers their stripe
+    B = allocate_real_matrix(size, -2);
+    C = taskid == 0 ? allocate_real_matrix(size, -2) : allocate_real_stripe(to - from, size);
+    if (taskid == 0 && fileB == NULL) first_touch_rows(B, size, size, 1);
+
+    if (taskid == 0)
+        initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
+
+    if (fileB != NULL)
+        mpiio_read_rows(fileB, size, 0, size, B);
+    else
+        MPI_Bcast(B, size * size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    // The stripe of rank 0 is the head of the whole CSR matrix
+    if (fileA != NULL) {
+        A = allocate_real_stripe(to - from, size);
+        mpiio_read_rows(fileA, size, from, to, A);
+        csr_from_dense(&a, to - from, size, A);
+        if (verify == 0 && !checksum) A = free_real_matrix(A, size);
+    } else {
+        if (taskid == 0) {
+            a = full;
+            a.rows = to - from;
+            a.nnz = nnz;
+        } else
+            csr_alloc(&a, to - from, size, nnz);
+        for (r = 0; r < numtasks; r++) {
+            displs[r] = bounds[r];
+            counts[r] = bounds[r + 1] - bounds[r];
+        }
+        if (taskid == 0)
+            MPI_Scatterv(full.rowptr, counts, displs, MPI_LONG, MPI_IN_PLACE, counts[0], MPI_LONG, 0, MPI_COMM_WORLD);
+        else
+            MPI_Scatterv(NULL, counts, displs, MPI_LONG, a.rowptr, counts[taskid], MPI_LONG, 0, MPI_COMM_WORLD);
+        for (r = 0; r < to - from; r++)  // from stripe-relative to local offsets
+            a.rowptr[r] -= cuts[taskid];
+        a.rowptr[to - from] = nnz;
+        for (r = 0; r < numtasks; r++) {
+            displs[r] = (int) cuts[r];
+            counts[r] = (int) (cuts[r + 1] - cuts[r]);
+        }
+        if (taskid == 0) {
+            MPI_Scatterv(full.col, counts, displs, MPI_INT, MPI_IN_PLACE, counts[0], MPI_INT, 0, MPI_COMM_WORLD);
+            MPI_Scatterv(full.val, counts, displs, MPI_DOUBLE, MPI_IN_PLACE, counts[0], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        } else {
+            MPI_Scatterv(NULL, counts, displs, MPI_INT, a.col, counts[taskid], MPI_INT, 0, MPI_COMM_WORLD);
+            MPI_Scatterv(NULL, counts, displs, MPI_DOUBLE, a.val, counts[taskid], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        }
+        if (taskid != 0 && (verify > 0 || checksum)) {  // the checks work on the dense stripe
+            A = allocate_real_stripe(to - from, size);
+            csr_to_dense(&a, A);
+        }
+    }
+
+    if (taskid == 0)
+        sendTime = my_ftime() - start_time_lt;  //-- ----------------- Measure send. Time
+
+    csr_multiply(&a, B, size, C);
+
+    if (taskid == 0)
+        compTime = my_ftime() - start_time_lt - sendTime; //-- --------Measure computing Time
+
+    // Get stripes of C from workers, unless they only go to the result file
+    for (r = 0; r < numtasks; r++) {
+        displs[r] = bounds[r] * size;
+        counts[r] = (bounds[r + 1] - bounds[r]) * size;
+    }
+    if (fileC != NULL && resultFileName == NULL && !debug)
+        ;
+    else if (taskid == 0)
+        MPI_Gatherv(MPI_IN_PLACE, counts[0], MPI_DOUBLE, C, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    else
+        MPI_Gatherv(C, counts[taskid], MPI_DOUBLE, NULL, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (taskid == 0)
+        gatherTime = my_ftime() - start_time_lt - sendTime - compTime; //-- --Measure gathering Time
+
+    MPI_Reduce(&nnz, &maxNnz, 1, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (taskid == 0) {
+        printf("Times (init, send, computing and gathering) = %.4g, %.4g, %.4g, %.4g sec\n\n", initTime / 1000.0,
+               sendTime / 1000.0, compTime / 1000.0, gatherTime / 1000.0);
+        printf("size=%d\tinitTime=%g\tsendTime=%g\tcomputeTime=%g\tgatherTime=%g (%lu min, %lu sec)\n", size,
+               initTime / 1000.0, sendTime / 1000.0, compTime / 1000.0, gatherTime / 1000.0,
+               (compTime / 1000) / 60, (compTime / 1000) % 60);
+        printf("sparse\tnnz=%ld\tdensity=%.4g\tmaxRankNnz=%ld\tavgRankNnz=%.0f\n", cuts[numtasks],
+               (double) cuts[numtasks] / size / size, maxNnz, (double) cuts[numtasks] / numtasks);
+        if (debug) {
+            fprintf(stderr, "C[%dx%d]=A*B:\n", size, size);
+            display(C, size, size < 100 ? size : 100);
+        }
+    }
+    if (verify > 0 || checksum) failed = verify_stripes(size, A, B, C, from, to, verify, checksum, taskid, numtasks);
+
+    if (taskid == 0)
+        save_result(C, size, resultFileName, debug);
+    if (fileC != NULL)
+        mpiio_write_rows(fileC, size, from, to, C, taskid);
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+    if (taskid == 0 && debug) fprintf(stderr, "Done!\n");
+
+    csr_free(fileA == NULL && taskid == 0 ? &full : &a);
+    free_real_matrix(A, size);
+    free_real_matrix(B, size);
+    free_real_matrix(C, size);
+    free(bounds);
+    free(counts);
+    free(displs);
+    free(cuts);
+    return failed;
+}
+
+//-- ----------------------------------------------------------------------------
+// Whole 'rows'x'cols' matrix from the row blocks of every rank (chain.h hook)
+const double *chain_allgather(const double *local, int rows, int cols, double *whole) {
+    int numtasks, taskid, r;
+    int *counts, *displs;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+    counts = (int *) malloc(numtasks * sizeof(int));
+    displs = (int *) malloc(numtasks * sizeof(int));
+    for (r = 0; r < numtasks; r++) {
+        displs[r] = block_low(r, numtasks, rows) * cols;
+        counts[r] = block_low(r + 1, numtasks, rows) * cols - displs[r];
+    }
+    MPI_Allgatherv(local, counts[taskid], MPI_DOUBLE, whole, counts, displs, MPI_DOUBLE, MPI_COMM_WORLD);
+    free(counts);
+    free(displs);
+    return whole;
+}
+
+//-- ----------------------------------------------------------------------------
+// Chain or power planned in 'ch' (chain=, power=, see chain.h) with every
+// matrix in row blocks: each rank fills its rows of the factors (row + 1),
+// computes its rows of every intermediate, and only the right operand of a
+// product is allgathered. C reaches rank 0 only to be dumped or displayed.
+// Returns 1 on rank 0 if the verification failed.
+int chain_stripe_multiply(chain_t *ch, int verify, int debug, int rss, char *resultFileName, int taskid,
+                          int numtasks) {
+    int factors = ch->power > 0 ? 1 : ch->n, M = ch->dims[0], N = ch->dims[ch->n], failed = 0, t, i, j, r;
+    int mine = block_low(taskid + 1, numtasks, M) - block_low(taskid, numtasks, M);
+    unsigned long start_time_lt = 0, initTime = 0, compTime = 0;
+    double *factor[CHAIN_MAX], *C, err;
+    char order[1024];
+
+    if (taskid == 0 && debug) fprintf(stderr, "\nStart parallel chain (M=%d, N=%d)...\n", M, N);
+    if (taskid == 0)
+        start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
+
+    for (t = 0; t < factors; t++) {
+        int from = block_low(taskid, numtasks, ch->dims[t]), cols = ch->dims[t + 1];
+        int rows = block_low(taskid + 1, numtasks, ch->dims[t]) - from;
+        factor[t] = allocate_real_stripe(rows, cols);
+#pragma omp parallel for private(j) schedule(static)
+        for (i = 0; i < rows; i++)
+            for (j = 0; j < cols; j++) factor[t][(long) i * cols + j] = from + i + 1;
+        ch->factor[t] = factor[t];
+    }
+    C = taskid == 0 ? allocate_real_stripe(M, N) : allocate_real_stripe(mine, N);
+
+    if (taskid == 0)
+        initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
+
+    chain_eval(ch, C);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if (taskid == 0)
+        compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+
+    if (resultFileName != NULL || debug) {
+        int *displs = (int *) malloc(numtasks * sizeof(int)), *counts = (int *) malloc(numtasks * sizeof(int));
+        for (r = 0; r < numtasks; r++) {
+            displs[r] = block_low(r, numtasks, M) * N;
+            counts[r] = block_low(r + 1, numtasks, M) * N - displs[r];
+        }
+        if (taskid == 0)
+            MPI_Gatherv(MPI_IN_PLACE, counts[0], MPI_DOUBLE, C, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        else
+            MPI_Gatherv(C, counts[taskid], MPI_DOUBLE, NULL, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        free(displs);
+        free(counts);
+    }
+
+    if (taskid == 0) {
+        chain_format(ch, order, sizeof(order));
+        printf("Times (init and computing) = %.4g, %.4g sec\n\n", initTime / 1000.0, compTime / 1000.0);
+        printf("M=%d\tN=%d\torder=%s\tproducts=%ld\tflops=%.4g\tleftToRightFlops=%.4g\tinitTime=%g\tcomputeTime=%g\t"
+               "GFLOPS=%.2f\n", M, N, order, ch->products, ch->flops, chain_flops(ch, 1), initTime / 1000.0,
+               compTime / 1000.0, compTime > 0 ? ch->flops / compTime / 1e6 : 0.0);
+        if (debug) fprintf(stderr, "C[0][0]=%g\tC[%d][%d]=%g\n", C[0], M - 1, N - 1, C[(long) M * N - 1]);
+        if (resultFileName != NULL) {
+            FILE *f = fopen(resultFileName + 1, "w");  // strchr points to the '=' sign
+            if (f == NULL)
+                fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+            else {
+                if (fwrite(C, sizeof(double), (size_t) M * N, f) != (size_t) M * N)
+                    fprintf(stderr, "Couldn't dump results to file\n");
+                fclose(f);
+            }
+        }
+    }
+    if (verify > 0) {
+        unsigned long seed = verify_seed();
+        MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+        err = chain_freivalds(ch, C, verify, seed);
+        MPI_Reduce(taskid == 0 ? MPI_IN_PLACE : &err, &err, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (taskid == 0) failed = verify_report_freivalds(err, chain_tol_size(ch), verify, seed);
+    }
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+
+    for (t = 0; t < factors; t++)
+        matrix_free(factor[t]);
+    matrix_free(C);
+    chain_free(ch);
+    return failed;
 }
 
 //-- ----------------------------------------------------------------------------
-// This function unallocated the matrix (frees memory)
-double *free_real_matrix(double *matrix, int size) {
-    if (matrix == NULL) return NULL;
+// Batched mode (see batch.h): 'count' independent products of 'n'x'n'
+// matrices. Rank 0 generates the pairs and scatters nearly equal blocks of
+// them, every rank multiplies its block with all its threads, and the
+// products are gathered back. One launch serves the whole batch. The
+// messages count whole matrices (a datatype of 'n'x'n' doubles), so a batch
+// may hold more than 2^31 doubles.
+void batch_parallel_multiply(int n, int count, int debug, int rss, char *resultFileName, int taskid, int numtasks) {
+    int first = block_low(taskid, numtasks, count), mine = block_low(taskid + 1, numtasks, count) - first, r;
+    int nn = n * n;
+    unsigned long start_time_lt = 0, initTime = 0, compTime = 0;
+    int *displs = (int *) malloc(numtasks * sizeof(int)), *counts = (int *) malloc(numtasks * sizeof(int));
+    double *A, *B, *C;
+    MPI_Datatype matrix;
 
-#if 0
-    for (int i = 0; i < size; i++)
-      if (matrix[i]) {
-         free(matrix[i]);  // frees a row of the matrix
-         matrix[i] = NULL;
-      }
-#endif
-    free(matrix);       // frees the pointer /
-    return NULL;        //returns a null pointer /
+    if (taskid == 0 && debug) fprintf(stderr, "\nStart batched MPI/OpenMP algorithm (%d x size=%d)...\n", count, n);
+    if (taskid == 0)
+        start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
+
+    // Rank 0 holds the whole batch, the workers their block of pairs
+    A = matrix_alloc((size_t) (taskid == 0 ? count : mine) * nn);
+    B = matrix_alloc((size_t) (taskid == 0 ? count : mine) * nn);
+    C = matrix_alloc((size_t) (taskid == 0 ? count : mine) * nn);
+    if (A == NULL || B == NULL || C == NULL) {
+        fprintf(stderr, "** Error in matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (taskid == 0) batch_fill(n, 0, count, A, B);
+    for (r = 0; r < numtasks; r++) {
+        displs[r] = block_low(r, numtasks, count);
+        counts[r] = block_low(r + 1, numtasks, count) - displs[r];
+    }
+    MPI_Type_contiguous(nn, MPI_DOUBLE, &matrix);
+    MPI_Type_commit(&matrix);
+
+    if (taskid == 0)
+        initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
+
+    if (taskid == 0) {
+        MPI_Scatterv(A, counts, displs, matrix, MPI_IN_PLACE, counts[0], matrix, 0, MPI_COMM_WORLD);
+        MPI_Scatterv(B, counts, displs, matrix, MPI_IN_PLACE, counts[0], matrix, 0, MPI_COMM_WORLD);
+    } else {
+        MPI_Scatterv(NULL, counts, displs, matrix, A, counts[taskid], matrix, 0, MPI_COMM_WORLD);
+        MPI_Scatterv(NULL, counts, displs, matrix, B, counts[taskid], matrix, 0, MPI_COMM_WORLD);
+    }
+
+    batch_multiply(n, mine, A, B, C);
+
+    if (taskid == 0)
+        MPI_Gatherv(MPI_IN_PLACE, counts[0], matrix, C, counts, displs, matrix, 0, MPI_COMM_WORLD);
+    else
+        MPI_Gatherv(C, counts[taskid], matrix, NULL, counts, displs, matrix, 0, MPI_COMM_WORLD);
+    MPI_Type_free(&matrix);
+
+    if (taskid == 0) {
+        compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+        printf("Times (init and computing) = %.4g, %.4g sec\n\n", initTime / 1000.0, compTime / 1000.0);
+        printf("size=%d\tbatch=%d\tinitTime=%g\tcomputeTime=%g\tmultipliesPerSec=%.0f\n", n, count,
+               initTime / 1000.0, compTime / 1000.0, compTime > 0 ? count * 1000.0 / compTime : 0.0);
+        if (debug) {
+            fprintf(stderr, "C_0[%dx%d]=A_0*B_0:\n", n, n);
+            display(C, n, n < 100 ? n : 100);
+        }
+        if (resultFileName != NULL) {
+            FILE *f = fopen(resultFileName + 1, "w");  // strchr points to the '=' sign
+            if (f == NULL)
+                fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+            else {
+                if (fwrite(C, sizeof(double), (size_t) count * nn, f) != (size_t) count * nn)
+                    fprintf(stderr, "Couldn't dump results to file\n");
+                fclose(f);
+            }
+        }
+    }
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+
+    matrix_free(A);
+    matrix_free(B);
+    matrix_free(C);
+    free(displs);
+    free(counts);
 }
 
 //-- ----------------------------------------------------------------------------
-// This function allocates a square matrix using malloc, and initializes it.
-// if 'random' is 0, initialize matrix to all 0s
-// if 'random' is -1, it initializes the matrix with random values (0->9).
-// if 'random' is -2 the matrix is initialized with no values in it.
-// else the matrix is initialized with the values of 'random' parameter.
-// The parameter 'size' defines the size of the matrix.
-double *allocate_real_matrix(int size, int random) {
-    int n = size, m = size, i, j;
-    double *matrix; //, a;     // pointer to the vector
+// C = alpha * op(A) * op(B) + beta * C with op(A) MxK and op(B) KxN (gemm=MxNxK,
+// see gemm_ex), by row stripes of C: the rows of C (M) are split between the
+// ranks, not 'size'. Rank 0 scatters the rows of op(A); a transposed A (KxM)
+// is scattered by columns with a strided datatype, so every rank receives its
+// rows of op(A) contiguous. op(B) is broadcast as stored and every rank
+// generates its stripe of C (all 1, as MOMP's gemm mode).
+void rect_stripe_multiply(int M, int N, int K, int transA, int transB, double alpha, double beta, int debug,
+                          int rss, char *resultFileName, int taskid, int numtasks) {
+    int from = block_low(taskid, numtasks, M), mine = block_low(taskid + 1, numtasks, M) - from, r, i, j;
+    int ra = transA ? K : M, ca = transA ? M : K, rb = transB ? N : K, cb = transB ? K : N;
+    unsigned long start_time_lt = 0, initTime, compTime;
+    int *displs = (int *) malloc(numtasks * sizeof(int)), *counts = (int *) malloc(numtasks * sizeof(int));
+    double *A = NULL, *Al, *B, *C;
+    MPI_Datatype col, column;
 
-    // allocates one vector of vectors (2D array = matrix)
-    //matrix = (double**) malloc(n * sizeof(double*));
-    matrix = (double *) malloc(n * n * sizeof(double));
+    if (taskid == 0 && debug) fprintf(stderr, "\nStart parallel gemm (M=%d, N=%d, K=%d)...\n", M, N, K);
+    if (taskid == 0)
+        start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
 
-    if (matrix == NULL) {
+    if (taskid == 0) A = matrix_alloc((size_t) ra * ca);
+    Al = matrix_alloc((size_t) mine * K);
+    B = matrix_alloc((size_t) rb * cb);
+    C = matrix_alloc((size_t) (taskid == 0 ? M : mine) * N);
+    if ((taskid == 0 && A == NULL) || Al == NULL || B == NULL || C == NULL) {
         fprintf(stderr, "** Error in matrix creation: insufficient memory **");
         fprintf(stderr, "** Program aborted................................ **");
-        exit(1);
-        //return (NULL);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    if (random == 0)
-        for (i = 0; i < size; ++i)
-            for (j = 0; j < m; j++)
-                matrix[i * size + j] = 0;
-    else if (random == -1)
-        for (i = 0; i < size; ++i)
-            for (j = 0; j < m; j++)
-                matrix[i * size + j] = i + 1;// rand() % 10;  // Initialize with a random value between 0 and 9
-    else if (random != -2)
-        for (i = 0; i < size; ++i)
-            for (j = 0; j < m; j++) matrix[i * size + j] = rand() * (i + j);
+    if (taskid == 0) {
+#pragma omp parallel for private(j) schedule(static)
+        for (i = 0; i < ra; i++)
+            for (j = 0; j < ca; j++) A[(long) i * ca + j] = i + 1;
+#pragma omp parallel for private(j) schedule(static)
+        for (i = 0; i < rb; i++)
+            for (j = 0; j < cb; j++) B[(long) i * cb + j] = i + 1;
+    }
+#pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < mine; i++)
+        for (j = 0; j < N; j++) C[(long) i * N + j] = 1;
 
-    return matrix;   // returns the pointer to the matrix.
+    if (taskid == 0)
+        initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
+
+    MPI_Bcast(B, rb * cb, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (transA) { // one column of the stored A (K values, stride M), one double apart from the next column
+        MPI_Type_vector(K, 1, M, MPI_DOUBLE, &col);
+        MPI_Type_create_resized(col, 0, sizeof(double), &column);
+        MPI_Type_commit(&column);
+        for (r = 0; r < numtasks; r++) {
+            displs[r] = block_low(r, numtasks, M);
+            counts[r] = block_low(r + 1, numtasks, M) - displs[r];
+        }
+        MPI_Scatterv(A, counts, displs, column, Al, mine * K, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Type_free(&column);
+        MPI_Type_free(&col);
+    } else {
+        for (r = 0; r < numtasks; r++) {
+            displs[r] = block_low(r, numtasks, M) * K;
+            counts[r] = block_low(r + 1, numtasks, M) * K - displs[r];
+        }
+        MPI_Scatterv(A, counts, displs, MPI_DOUBLE, Al, mine * K, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    }
+
+    gemm_ex(0, transB, mine, N, K, alpha, Al, K, B, cb, beta, C, N);
+
+    for (r = 0; r < numtasks; r++) {
+        displs[r] = block_low(r, numtasks, M) * N;
+        counts[r] = block_low(r + 1, numtasks, M) * N - displs[r];
+    }
+    if (taskid == 0)
+        MPI_Gatherv(MPI_IN_PLACE, counts[0], MPI_DOUBLE, C, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    else
+        MPI_Gatherv(C, counts[taskid], MPI_DOUBLE, NULL, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (taskid == 0) {
+        compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+        printf("Times (init and computing) = %.4g, %.4g sec\n\n", initTime / 1000.0, compTime / 1000.0);
+        printf("M=%d\tN=%d\tK=%d\ttransA=%d\ttransB=%d\tinitTime=%g\tcomputeTime=%g\tGFLOPS=%.2f\n", M, N, K,
+               transA, transB, initTime / 1000.0, compTime / 1000.0,
+               compTime > 0 ? 2.0 * M * N * K / compTime / 1e6 : 0.0);
+        if (debug) fprintf(stderr, "C[0][0]=%g\tC[%d][%d]=%g\n", C[0], M - 1, N - 1, C[(long) M * N - 1]);
+        if (resultFileName != NULL) {
+            FILE *f = fopen(resultFileName + 1, "w");  // strchr points to the '=' sign
+            if (f == NULL)
+                fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+            else {
+                if (fwrite(C, sizeof(double), (size_t) M * N, f) != (size_t) M * N)
+                    fprintf(stderr, "Couldn't dump results to file\n");
+                fclose(f);
+            }
+        }
+    }
+    if (rss) report_peak_rss(taskid, numtasks, debug);
+
+    matrix_free(A);
+    matrix_free(Al);
+    matrix_free(B);
+    matrix_free(C);
+    free(displs);
+    free(counts);
 }
 
-//-- ----------------------------------------------------------------------------*/
-// Display 'size'x'size' elements of 'matrix' for debugging purposes
-void display(double *matrix, int size, int atmost) {
-    int i, j, limit = size < atmost ? size : atmost;
-    for (i = 0; i < limit; i++) {
-        for (j = 0; j < limit; j++)
-            fprintf(stderr, "%6.1lf ", matrix[i * size + j]);
-        //printf("%6.1lf ", (double)(*matrix+(i*size+j)));
-        if (atmost < size) fprintf(stderr, "...");
-        fprintf(stderr, "\n");
+//-- ----------------------------------------------------------------------------
+// Server mode: the ranks stay up and run a stream of multiply jobs, so
+// MPI_Init, the allocation and the page faults are paid once. Rank 0 reads
+// one job per line, from a job file ('-' for stdin) or from the clients of a
+// local socket (serve=unix:/path), and answers each job with one result line:
+//     <size> [nopack] [dump=file]   multiply generated size x size matrices
+//     quit                          stop the server
+// Empty lines and lines starting with '#' are skipped; any other line that
+// is not a job is answered with "error: <line>".
+// Buffers stay allocated between jobs and are only replaced (arena_init)
+// when a job is larger than all the previous ones.
+
+// Buffers kept between the jobs
+typedef struct {
+    int cap;                    // largest size they fit
+    double *A, *B, *C, *Bp;
+} job_buffers_t;
+
+//-- ----------------------------------------------------------------------------
+// Make the buffers fit a 'size'x'size' job. Returns 1 if they were reused.
+int job_buffers_fit(job_buffers_t *jb, int size, int taskid, int numtasks, int huge) {
+    int rows = taskid == 0 ? size : (size + numtasks - 1) / numtasks;  // largest stripe of a worker
+
+    if (size <= jb->cap) return 1;
+    arena_init(3 * arena_bytes((size_t) size * size) + arena_bytes(gemm_packed_b_size(size)), huge);
+    jb->A = allocate_real_stripe(rows, size);
+    jb->B = allocate_real_stripe(size, size);
+    jb->C = allocate_real_stripe(rows, size);
+    jb->Bp = gemm_alloc_packed_b(size);
+    jb->cap = size;
+    return 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Write the line 'text' to the output of rank 0 and to the client, if any
+void job_reply(FILE *client, const char *text) {
+    fputs(text, stdout);
+    fflush(stdout);
+    if (client != NULL) {
+        fputs(text, client);
+        fflush(client);
     }
-    if (atmost < size) fprintf(stderr, "   .... .... ...\n");
-    fprintf(stderr, "\n-----------------------\n");
 }
 
-// -- --------------------------------------------------------------------
-// dump matrix in binary format - simply to allow quick compare with another result file
-void dump(double *matrix, int size, FILE *f) {
-    if (fwrite(matrix, sizeof(double), size, f) != size)
-        fprintf(stderr, "Couldn't dump results to file\n");
+//-- ----------------------------------------------------------------------------
+// Read the next job on rank 0: from 'in', or from the next client of the
+// listening socket 'lsock' when 'in' reaches its end (the client is read
+// through 'in' and answered through 'client', two streams on the socket).
+// Fills 'job' (size, pack, quit) and 'dumpName'; returns 0 when there is
+// nothing left to read.
+int next_job(FILE **in, int lsock, FILE **client, int job[3], char *dumpName, size_t dumpLen) {
+    char line[1024], text[1040], *tok, *end;
+    long n;
+    int bad;
+
+    for (;;) {
+        if (*in != NULL && fgets(line, sizeof(line), *in) != NULL) {
+            line[strcspn(line, "\r\n")] = '\0';
+            tok = line + strspn(line, " \t");
+            if (*tok == '\0' || *tok == '#') continue;  // empty or comment line
+            snprintf(text, sizeof(text), "error: %s\n", tok);
+            job[0] = 0;
+            job[1] = 1;
+            job[2] = 0;
+            bad = 0;
+            dumpName[0] = '\0';
+            for (tok = strtok(line, " \t"); tok != NULL; tok = strtok(NULL, " \t")) {
+                if (isdigit(tok[0])) {
+                    n = strtol(tok, &end, 10);
+                    if (*end != '\0' || n <= 0 || n > INT_MAX / n)  // size*size is an int count of MPI
+                        bad = 1;
+                    else
+                        job[0] = (int) n;
+                } else if (strcmp(tok, "nopack") == 0)
+                    job[1] = 0;
+                else if (strncmp(tok, "dump=", 5) == 0)
+                    snprintf(dumpName, dumpLen, "%s", tok + 5);
+                else if (strcmp(tok, "quit") == 0)
+                    job[2] = 1;
+                else
+                    bad = 1;
+            }
+            if (!bad && (job[0] > 0 || job[2])) return 1;
+            job_reply(*client, text);
+            continue;
+        }
+        if (lsock < 0) return 0;  // end of the job file
+        if (*in != NULL) fclose(*in);
+        if (*client != NULL) fclose(*client);
+        *in = *client = NULL;
+        int fd = accept(lsock, NULL, NULL), out;
+        if (fd < 0) continue;
+        if ((out = dup(fd)) < 0 || (*in = fdopen(fd, "r")) == NULL || (*client = fdopen(out, "w")) == NULL) {
+            if (*in != NULL) fclose(*in);
+            else close(fd);
+            if (out >= 0) close(out);
+            *in = NULL;
+        }
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// One row stripe multiply on the buffers 'jb' (A and B filled on rank 0):
+// broadcast of B, scatter of A, packing (if 'pack'), computation (with the
+// original triple loop if 'naive') and gather of C on rank 0. Returns the
+// MPI_Wtime at which the operands were distributed.
+double stripe_job(job_buffers_t *jb, int size, int pack, int naive, int taskid, int numtasks) {
+    int from = block_low(taskid, numtasks, size), to = block_low(taskid + 1, numtasks, size), i, r;
+    int *displs = (int *) malloc(numtasks * sizeof(int)), *counts = (int *) malloc(numtasks * sizeof(int));
+    double sent;
+
+    for (r = 0; r < numtasks; r++) {
+        displs[r] = block_low(r, numtasks, size) * size;
+        counts[r] = block_low(r + 1, numtasks, size) * size - displs[r];
+    }
+    MPI_Bcast(jb->B, size * size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (taskid == 0)
+        MPI_Scatterv(jb->A, counts, displs, MPI_DOUBLE, MPI_IN_PLACE, counts[0], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    else
+        MPI_Scatterv(NULL, counts, displs, MPI_DOUBLE, jb->A, counts[taskid], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    sent = MPI_Wtime();
+
+    if (naive) {
+#pragma omp parallel for schedule(static)
+        for (i = 0; i < to - from; i++)
+            gemm_naive_rows(size, jb->A, jb->B, jb->C, i, i + 1);
+    } else {
+        if (pack) {
+#pragma omp parallel for schedule(static)
+            for (i = 0; i < gemm_pack_b_panels(size); i++)
+                gemm_pack_b_panel(size, jb->B, jb->Bp, i);
+        }
+#pragma omp parallel for schedule(runtime)
+        for (i = 0; i < to - from; i += gemm_mc)
+            gemm_block_rows_ex(size, jb->A, jb->B, pack ? jb->Bp : NULL, jb->C, i,
+                               GEMM_MIN(i + gemm_mc, to - from));
+    }
+    if (taskid == 0)
+        MPI_Gatherv(MPI_IN_PLACE, counts[0], MPI_DOUBLE, jb->C, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    else
+        MPI_Gatherv(jb->C, counts[taskid], MPI_DOUBLE, NULL, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    free(displs);
+    free(counts);
+    return sent;
+}
+
+//-- ----------------------------------------------------------------------------
+// Fill A and B of the buffers 'jb' on rank 0 like the default mode (row + 1)
+void stripe_fill(job_buffers_t *jb, int size, int taskid) {
+    int i, j;
+
+    if (taskid != 0) return;
+#pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < size; i++)
+        for (j = 0; j < size; j++) jb->A[(long) i * size + j] = jb->B[(long) i * size + j] = i + 1;
+}
+
+//-- ----------------------------------------------------------------------------
+// Benchmark of the row stripe mode (bench=<reps>): 'warmup' untimed jobs, then
+// 'reps' timed ones. A job (distribution, packing, computation and gather) is
+// timed from a barrier to the end of the slowest rank. 'naive' times the
+// original triple loop on the stripes (the baseline of the kernels).
+void bench_stripe(int size, int pack, int naive, int huge, int reps, int warmup, char *benchFile, int json,
+                  int taskid, int numtasks) {
+    job_buffers_t jb = {0, NULL, NULL, NULL, NULL};
+    bench_record_t rec = {"MParallel", naive ? "stripe-naive" : pack ? "stripe-packed" : "stripe-blocked", "double",
+                          size, numtasks, omp_get_max_threads(), warmup, reps};
+    double samples[BENCH_MAX_REPS], t, mine;
+    int r;
+
+    job_buffers_fit(&jb, size, taskid, numtasks, huge);
+    stripe_fill(&jb, size, taskid);
+    for (r = -warmup; r < reps; r++) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        t = MPI_Wtime();
+        stripe_job(&jb, size, pack, naive, taskid, numtasks);
+        mine = MPI_Wtime() - t;
+        MPI_Reduce(&mine, &t, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (r >= 0) samples[r] = t;
+    }
+    if (taskid == 0) {
+        bench_stats(&rec, samples, rec.ranks * rec.threads);
+        bench_report(&rec, benchFile, json);
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// Run the jobs of 'source' (see above) with row stripes, as the default mode
+void serve_jobs(char *source, int debug, int rss, int huge, double startup, int taskid, int numtasks) {
+    job_buffers_t jb = {0, NULL, NULL, NULL, NULL};
+    FILE *in = NULL, *client = NULL;
+    int lsock = -1, job[3], njobs = 0;
+    char dumpName[512], result[512];
+
+    if (taskid == 0) {
+        if (strncmp(source, "unix:", 5) == 0) {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", source + 5);
+            unlink(addr.sun_path);
+            lsock = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (lsock < 0 || bind(lsock, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(lsock, 4) != 0) {
+                fprintf(stderr, "** Cannot listen on %s **\n", source + 5);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        } else if ((in = strcmp(source, "-") == 0 ? stdin : fopen(source, "r")) == NULL) {
+            fprintf(stderr, "** Cannot read job file %s **\n", source);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        printf("serverStartup=%g\tranks=%d\tthreads=%d\n", startup, numtasks, omp_get_max_threads());
+        fflush(stdout);
+    }
+
+    for (;;) {
+        double t0, t1, t2, t3;
+        int reused, size;
+
+        if (taskid == 0 && !next_job(&in, lsock, &client, job, dumpName, sizeof(dumpName)))
+            job[2] = 1;
+        MPI_Bcast(job, 3, MPI_INT, 0, MPI_COMM_WORLD);
+        if (job[2]) break;
+
+        t0 = MPI_Wtime();
+        size = job[0];
+        reused = job_buffers_fit(&jb, size, taskid, numtasks, huge);
+        stripe_fill(&jb, size, taskid);
+        t1 = MPI_Wtime();
+
+        t2 = stripe_job(&jb, size, job[1], 0, taskid, numtasks);
+        t3 = MPI_Wtime();
+
+        if (taskid == 0) {
+            if (dumpName[0] != '\0') {
+                FILE *f = fopen(dumpName, "w");
+                if (f == NULL)
+                    fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+                else {
+                    dump(jb.C, size, f);
+                    fclose(f);
+                }
+            }
+            snprintf(result, sizeof(result),
+                     "job=%d\tsize=%d\treused=%d\tinitTime=%g\tsendTime=%g\tcomputeTime=%g\tlatency=%g\n", njobs,
+                     size, reused, t1 - t0, t2 - t1, t3 - t2, MPI_Wtime() - t0);
+            job_reply(client, result);
+            if (debug) display(jb.C, size, size < 10 ? size : 10);
+        }
+        njobs++;
+    }
+
+    if (taskid == 0) {
+        if (in != NULL && in != stdin) fclose(in);
+        if (client != NULL) fclose(client);
+        if (lsock >= 0) {
+            close(lsock);
+            unlink(source + 5);
+        }
+        printf("served=%d jobs\n", njobs);
+    }
+    if (rss) report_peak_rss(taskid, numtasks, debug);
 }
 
 // -- -----------------------------------------------------------
 int main(int argc, char *argv[]) {
-    int size, debug = 0, taskid, numtasks, nbthreads = 1;
-    unsigned long start_time_lt, initTime, compTime, sendTime;
+    int size = 0, debug = 0, taskid, numtasks, nbthreads = 0, pack = 1, summa = 0, pipeline = 0, hybrid = 0, dynamic = 0, rss = 0, huge = 0, ooc = 0, memMB = OOC_DEFAULT_MEM, type = ELEM_F64, provided;
+    int M = 0, N = 0, K = 0, transA = 0, transB = 0;
+    int chainDims[CHAIN_MAX + 1], factors = 0, power = 0;
+    double alpha = 1, beta = 0;
+    char *serve = NULL, *benchFile = NULL;
+    int reps = 0, warmup = 1, json = 0, naive = 0, perf = 0, verify = 0, checksum = 0, failed = 0, shared = 0;
+    int sparse = -1;
+    long batch = 0;
+    double density = 1;
+    node_comms_t nc;
+    MPI_Win winB, winBp;
+    unsigned long launch_time = my_ftime();
+    unsigned long start_time_lt = 0, initTime = 0, compTime = 0, sendTime = 0, packTime = 0, gatherTime = 0;
     double start, finish;
     char *resultFileName = NULL;
-    register int i, j, k;
+    char *fileA = NULL, *fileB = NULL, *fileC = NULL;  // matrix files, see matio.h
+    matio_header_t hdr;
+    register int i, k;
     register double *A;
     register double *B;
     register double *C;
 
     // rudimentary argument collecting
     for (k = 1; k < argc; ++k) {
-        if (isdigit(argv[k][0]))    // assume it is the matrix size
+        if (isdigit(argv[k][0]) && size == 0) // assume the first number is the matrix size
             size = atoi(argv[k]);
-	else if (isdigit(argv[k][0]) && size > 0) { // assume the second number is the number of threads
-	    nbthreads = atoi(argv[k]);
-	    omp_set_num_threads(nbthreads);
-	}
+        else if (isdigit(argv[k][0])) {       // and the second the number of threads per rank
+            nbthreads = atoi(argv[k]);
+            omp_set_num_threads(nbthreads);
+        }
         else if (strncmp(argv[k], "dump", 4) == 0) // assume dump=filename
             resultFileName = strchr(argv[k], '=');
+        else if (strcmp(argv[k], "nopack") == 0)   // multiply B in place, no packing
+            pack = 0;
+        else if (strcmp(argv[k], "naive") == 0)    // bench: original triple loop (benchmark baseline)
+            naive = 1;
+        else if (strcmp(argv[k], "summa") == 0)    // 2D process grid instead of row stripes
+            summa = 1;
+        else if (strcmp(argv[k], "pipeline") == 0) // overlap communication and computation
+            pipeline = 1;
+        else if (strcmp(argv[k], "hybrid") == 0)   // pinned threads, NUMA-local first touch
+            hybrid = 1;
+        else if (strcmp(argv[k], "shared") == 0)   // one copy of B per host (MPI-3 shared memory)
+            shared = 1;
+        else if (strcmp(argv[k], "sparse") == 0)   // CSR stripes of A (default: when A is sparse enough)
+            sparse = 1;
+        else if (strcmp(argv[k], "dense") == 0)    // dense stripes whatever the density of A
+            sparse = 0;
+        else if (strncmp(argv[k], "density=", 8) == 0) // generate A with this fraction of nonzeros
+            density = atof(argv[k] + 8);
+        else if (strcmp(argv[k], "dynamic") == 0)  // tiles handed out on request by rank 0
+            dynamic = 1;
+        else if (strcmp(argv[k], "huge") == 0)     // back the matrices with 2 MB pages
+            huge = 1;
+        else if (strncmp(argv[k], "A=", 2) == 0)   // each rank reads its stripe of A from a matrix file
+            fileA = argv[k] + 2;
+        else if (strncmp(argv[k], "B=", 2) == 0)   // each rank reads B from a matrix file
+            fileB = argv[k] + 2;
+        else if (strncmp(argv[k], "out=", 4) == 0) // each rank writes its stripe of C to a matrix file
+            fileC = argv[k] + 4;
+        else if (strcmp(argv[k], "ooc") == 0)      // out-of-core: stream tiles of A=, B= to out=
+            ooc = 1;
+        else if (strncmp(argv[k], "mem=", 4) == 0) { // memory budget per rank of the out-of-core mode (MB)
+            if ((memMB = atoi(argv[k] + 4)) <= 0) {
+                fprintf(stderr, "** mem=<MB> expects a positive budget **\n");
+                exit(1);
+            }
+        }
+        else if (bench_option(argv[k], &reps, &warmup, &benchFile, &json)) // bench=, warmup=, csv=, json=
+            ;
+        else if (strncmp(argv[k], "serve=", 6) == 0) // serve=jobfile, serve=- or serve=unix:/path (server mode)
+            serve = argv[k] + 6;
+        else if (strncmp(argv[k], "gemm=", 5) == 0) { // gemm=MxNxK rectangular product
+            if (sscanf(argv[k] + 5, "%dx%dx%d", &M, &N, &K) != 3 || M <= 0 || N <= 0 || K <= 0) {
+                fprintf(stderr, "** gemm=MxNxK expected **\n");
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[k], "chain=", 6) == 0) { // chain=p0xp1x...xpn product of factors pt x pt+1
+            if ((factors = chain_parse(argv[k] + 6, chainDims)) < 0) {
+                fprintf(stderr, "** chain=p0xp1x...xpn expected (at most %d factors) **\n", CHAIN_MAX);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[k], "power=", 6) == 0) { // power=k: A^k by repeated squaring
+            if ((power = atoi(argv[k] + 6)) < 1) {
+                fprintf(stderr, "** power=<k> expects a power of 1 or more **\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[k], "transA") == 0)   // gemm: op(A) = A transposed
+            transA = 1;
+        else if (strcmp(argv[k], "transB") == 0)   // gemm: op(B) = B transposed
+            transB = 1;
+        else if (strncmp(argv[k], "alpha=", 6) == 0)
+            alpha = atof(argv[k] + 6);
+        else if (strncmp(argv[k], "beta=", 5) == 0)
+            beta = atof(argv[k] + 5);
+        else if (strncmp(argv[k], "batch=", 6) == 0) // batch=count independent size x size products
+            batch = atol(argv[k] + 6);
+        else if (strncmp(argv[k], "type=", 5) == 0) { // element type: double, float, int32 or mixed
+            if ((type = elem_parse(argv[k] + 5)) < 0) {
+                fprintf(stderr, "** Unknown element type %s **\n", argv[k] + 5);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[k], "rss") == 0)      // report the peak memory of every rank
+            rss = 1;
+        else if (strcmp(argv[k], "perf") == 0)     // per phase times and hardware counters of every rank
+            perf = 1;
+        else if (strncmp(argv[k], "verify", 6) == 0) // verify or verify=rounds: Freivalds check of C
+            verify = argv[k][6] == '=' ? atoi(argv[k] + 7) : 1;
+        else if (strcmp(argv[k], "checksum") == 0) // checksum of every stripe of C, checked where computed
+            checksum = 1;
         else if (debug = strncmp(argv[k], "debug", 5) == 0) // want debuging info
             fprintf(stderr, "debug is now on.\n");
     }
 
-    MPI_Init(&argc, &argv);
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); // MPI is only called by master threads
     MPI_Comm_rank(MPI_COMM_WORLD, &taskid); /* who am i */
     MPI_Comm_size(MPI_COMM_WORLD, &numtasks); /* number of processors */
 
+    // Operands read from files give the size; matrix files are only handled by the row stripe mode
+    if ((fileA != NULL && mpiio_square_size(fileA, &size, &hdr) != 0) ||
+        (fileB != NULL && mpiio_square_size(fileB, &size, &hdr) != 0))
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    if ((fileA != NULL || fileB != NULL || fileC != NULL) && (summa || dynamic || pipeline)) {
+        if (taskid == 0) fprintf(stderr, "** A=, B= and out= are only supported by the row stripe mode **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (reps > 0 && (serve != NULL || M > 0 || batch > 0 || type != ELEM_F64 || fileA != NULL || fileB != NULL ||
+                     fileC != NULL || ooc || summa || dynamic || pipeline)) {
+        if (taskid == 0) fprintf(stderr, "** bench measures the row stripe mode only **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (naive && reps == 0) {
+        if (taskid == 0) fprintf(stderr, "** naive is only a baseline of bench **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (serve != NULL && (M > 0 || batch > 0 || type != ELEM_F64 || fileA != NULL || fileB != NULL || fileC != NULL ||
+                          ooc || summa || dynamic || pipeline)) {
+        if (taskid == 0) fprintf(stderr, "** serve runs row stripe jobs only **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (M > 0 && (batch > 0 || type != ELEM_F64 || fileA != NULL || fileB != NULL || fileC != NULL || ooc || summa ||
+                  dynamic || pipeline || hybrid)) {
+        if (taskid == 0) fprintf(stderr, "** gemm only multiplies generated double matrices by row stripes **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (batch > 0 && (type != ELEM_F64 || fileA != NULL || fileB != NULL || fileC != NULL || ooc || summa || dynamic ||
+                      pipeline || hybrid)) {
+        if (taskid == 0) fprintf(stderr, "** batch only multiplies generated double matrices **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (batch > INT_MAX) {  // the pairs are counted in int by MPI_Scatterv
+        if (taskid == 0) fprintf(stderr, "** batch=<count> expects at most %d pairs **\n", INT_MAX);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (type != ELEM_F64 && (fileA != NULL || fileB != NULL || fileC != NULL || ooc || summa || dynamic || pipeline ||
+                             hybrid)) {
+        if (taskid == 0) fprintf(stderr, "** Only the default row stripe mode handles other types than double **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (perf && (reps > 0 || serve != NULL || M > 0 || batch > 0 || type != ELEM_F64 || ooc || summa || dynamic ||
+                 pipeline)) {
+        if (taskid == 0) fprintf(stderr, "** perf instruments the row stripe mode only **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if ((verify > 0 || checksum) && (reps > 0 || serve != NULL || M > 0 || batch > 0 || type != ELEM_F64 || ooc ||
+                                     summa || dynamic || pipeline)) {
+        if (taskid == 0) fprintf(stderr, "** verify and checksum check the row stripe mode only **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (shared && (reps > 0 || serve != NULL || M > 0 || batch > 0 || type != ELEM_F64 || ooc || summa || dynamic ||
+                   pipeline)) {
+        if (taskid == 0) fprintf(stderr, "** shared only applies to the row stripe mode **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if ((sparse > 0 || density < 1) && (reps > 0 || serve != NULL || M > 0 || batch > 0 || type != ELEM_F64 || ooc ||
+                                        summa || dynamic || pipeline)) {
+        if (taskid == 0) fprintf(stderr, "** sparse and density= only apply to the row stripe mode **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (sparse > 0 && (shared || perf)) {
+        if (taskid == 0) fprintf(stderr, "** sparse does not support shared and perf **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if ((factors > 0 || power > 0) &&
+        ((factors > 0 && power > 0) || (power > 0 && size <= 0) || reps > 0 || serve != NULL || M > 0 || batch > 0 ||
+         type != ELEM_F64 || fileA != NULL || fileB != NULL || fileC != NULL || ooc || summa || dynamic || pipeline ||
+         shared || sparse > 0 || perf || checksum)) {
+        if (taskid == 0)
+            fprintf(stderr, "** chain= or power= (with a size) only multiply generated double matrices **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (ooc && (fileA == NULL || fileB == NULL || fileC == NULL || resultFileName != NULL)) {
+        if (taskid == 0) fprintf(stderr, "** ooc needs A=, B= and out= (and no dump) **\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
     int stripe_height = size / numtasks;
     int extra_stripe_height = size % numtasks; // if size isn't divisible by number of processors
 
@@ -137,6 +2026,116 @@ int main(int argc, char *argv[]) {
 
     if (taskid == 0 && debug) fprintf(stderr, "\nStart parallel MPI/OpenMP algorithm (size=%d)...\n", size);
 
+    // Each rank picks the micro kernel of its own host (grid nodes differ)
+    const gemm_kernel_t *kern = gemm_init();
+    if (debug) fprintf(stderr, "Rank %d uses %s micro kernel (%dx%d)\n", taskid, kern->name, kern->mr, kern->nr);
+
+    // Block sizes, schedule and (unless given) threads cached for this host by MOMP tune
+    tune_config_t tuned;
+    if (tune_load(&tuned, nbthreads == 0, debug) && tuned.ranks > 0) {
+        MPI_Comm node;
+        int local;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, taskid, MPI_INFO_NULL, &node);
+        MPI_Comm_size(node, &local);
+        if (local != tuned.ranks && (debug || taskid == 0))
+            fprintf(stderr, "Rank %d: %d ranks on this node, tuned for %d ranks of %d threads\n", taskid, local,
+                    tuned.ranks, tuned.threads);
+        MPI_Comm_free(&node);
+    }
+
+    if (hybrid) { // first touch and compute must split the rows the same way
+        pin_threads(taskid, debug);
+        omp_set_schedule(omp_sched_static, 0);
+    }
+    if (perf) perf_open();  // after pinning: the counters follow their threads anyway
+
+    if (ooc) {  // no arena: only tiles of the matrices are ever in memory
+        ooc_parallel_multiply(size, debug, rss, memMB, fileA, fileB, fileC, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (reps > 0) {
+        bench_stripe(size, pack, naive, huge, reps, warmup, benchFile, json, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (serve != NULL) {  // startup = launch, MPI_Init, kernel selection and pinning
+        serve_jobs(serve, debug, rss, huge, (my_ftime() - launch_time) / 1000.0, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (factors > 0 || power > 0) {  // no arena: the intermediates live in the pool of the chain
+        chain_t ch;
+        chain_init(&ch, taskid, numtasks, numtasks > 1 ? chain_allgather : NULL);
+        if (power > 0)
+            chain_plan_power(&ch, size, power);
+        else
+            chain_plan(&ch, factors, chainDims);
+        failed = chain_stripe_multiply(&ch, verify, debug, rss, resultFileName, taskid, numtasks);
+        MPI_Finalize();
+        return failed;
+    }
+
+    if (M > 0) {
+        arena_init(arena_bytes((size_t) M * K) * 2 + arena_bytes((size_t) K * N) + arena_bytes((size_t) M * N), huge);
+        rect_stripe_multiply(M, N, K, transA, transB, alpha, beta, debug, rss, resultFileName, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (batch > 0) {
+        arena_init(3 * arena_bytes((size_t) batch * size * size), huge);
+        batch_parallel_multiply(size, (int) batch, debug, rss, resultFileName, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+
+    // One arena per rank, sized for the largest need (rank 0: A, B, C and packed B).
+    // It is only reserved: pages a rank never touches cost no memory.
+    arena_init(3 * arena_bytes((size_t) size * size) + arena_bytes(gemm_packed_b_size(size)), huge);
+
+    if (type != ELEM_F64) {
+        typed_stripe_multiply(size, type, debug, rss, resultFileName, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+    if (summa) {
+        summa_multiply(size, debug, rss, resultFileName, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+    if (dynamic) {
+        if (provided < MPI_THREAD_FUNNELED && taskid == 0) { // no server thread: serve and compute in turn
+            fprintf(stderr, "MPI provides no MPI_THREAD_FUNNELED, rank 0 of the dynamic mode runs one thread\n");
+            omp_set_num_threads(1);
+        }
+        dynamic_multiply(size, debug, rss, pack, resultFileName, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+    if (pipeline) {
+        pipeline_multiply(size, debug, rss, resultFileName, taskid, numtasks);
+        MPI_Finalize();
+        return 0;
+    }
+
+    // A sparser than sparse_threshold() is sent as CSR stripes of the same nonzero count
+    // (a generated A has the density asked for, a file is sampled)
+    if (sparse < 0 && !shared && !perf)
+        sparse = (fileA != NULL ? mpiio_sample_density(fileA, size, taskid) : density) < sparse_threshold();
+    if (sparse > 0) {
+        failed = sparse_stripe_multiply(size, density, debug, rss, verify, checksum, resultFileName, fileA, fileB,
+                                        fileC, taskid, numtasks);
+        MPI_Finalize();
+        return failed;
+    }
+
+    perf_phase_t phase[PH_COUNT] = {{"alloc"}, {"init"}, {"bcast"}, {"scatter"}, {"pack"}, {"compute"},
+                                    {"wait"}, {"gather"}};
+
     // Init time = time to allocate and to send matrices to workers
     if (taskid == 0)
         start_time_lt = my_ftime();  //-- -------------------------- Take starting Time
@@ -144,18 +2143,51 @@ int main(int argc, char *argv[]) {
     int stripe_size = stripe_height * size;
     int last_stripe_size = extra_stripe_height * size + stripe_size;
 
+    // Allocation and filling are separate phases (the fill is also the first touch)
+    perf_phase_begin(&phase[PH_ALLOC]);
+    if (shared) { // B lives once per host, in a window of the node leader
+        node_split(&nc, taskid);
+        B = node_shared_alloc(&nc, (size_t) size * size, &winB);
+        if (debug) fprintf(stderr, "Rank %d shares B with the %d ranks of its node\n", taskid, nc.nodesize);
+    }
     if (taskid == 0) { // Fill only on master node
-        A = allocate_real_matrix(size, -1);
-        B = allocate_real_matrix(size, -1);
-        C = allocate_real_matrix(size, -2);
-    } else {
         A = allocate_real_matrix(size, -2);
-        B = allocate_real_matrix(size, -2);
+        if (!shared) B = allocate_real_matrix(size, -2);
         C = allocate_real_matrix(size, -2);
+    } else { // Workers only hold their own stripe of A and C (rows 'from'..'to'-1)
+        A = allocate_real_stripe(to - from, size);
+        if (!shared) B = allocate_real_matrix(size, -2);
+        C = allocate_real_stripe(to - from, size);
     }
+    perf_phase_end(&phase[PH_ALLOC]);
+    perf_phase_begin(&phase[PH_INIT]);
+    if (hybrid) { // Pages are first touched by the threads that compute on them
+        first_touch_rows(A, taskid == 0 ? size : to - from, size, taskid == 0 && fileA == NULL);
+        if (!shared || taskid == 0) first_touch_rows(B, size, size, taskid == 0 && fileB == NULL);
+        first_touch_rows(C, taskid == 0 ? size : to - from, size, 0);
+    } else if (taskid == 0) {
+        if (fileA == NULL) first_touch_rows(A, size, size, 1);
+        if (fileB == NULL) first_touch_rows(B, size, size, 1);
+    }
+    if (taskid == 0 && fileA == NULL) sparse_thin(A, size, size, 0, density);
+    perf_phase_end(&phase[PH_INIT]);
 
     // Each node compute size / #nodes lines of C so we need to broadcast full matrix B
-    MPI_Bcast(B, size * size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    // (or every node reads it from its file)
+    // With shared, only the node leaders receive B (the ranks of a host read a part of the file each)
+    perf_phase_begin(&phase[PH_BCAST]);
+    if (shared) {
+        int r0 = block_low(nc.noderank, nc.nodesize, size), r1 = block_low(nc.noderank + 1, nc.nodesize, size);
+        if (fileB != NULL)
+            mpiio_read_rows(fileB, size, r0, r1, B + (long) r0 * size);
+        else if (nc.leaders != MPI_COMM_NULL)
+            MPI_Bcast(B, size * size, MPI_DOUBLE, 0, nc.leaders);
+        MPI_Win_fence(0, winB);  // B complete for every rank of the node
+    } else if (fileB != NULL)
+        mpiio_read_rows(fileB, size, 0, size, B);
+    else
+        MPI_Bcast(B, size * size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    perf_phase_end(&phase[PH_BCAST]);
 
     // Send only my concerned stripe
     int *displs = (int *) malloc(numtasks * sizeof(int)); /* displacement (relative to send buffer) */
@@ -174,12 +2206,16 @@ int main(int argc, char *argv[]) {
     if (taskid == 0)
         initTime = my_ftime() - start_time_lt; //-- ------------------ Measure init. Time
 
-    // Send stripes of A to workers
-    if (taskid == 0)
+    // Send stripes of A to workers (or every node reads its own stripe from the file)
+    perf_phase_begin(&phase[PH_SCATTER]);
+    if (fileA != NULL)
+        mpiio_read_rows(fileA, size, from, to, A);
+    else if (taskid == 0)
         MPI_Scatterv(A, scounts, displs, MPI_DOUBLE, MPI_IN_PLACE, stripe_size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
     else
-        MPI_Scatterv(A, scounts, displs, MPI_DOUBLE, A + from * size,
+        MPI_Scatterv(A, scounts, displs, MPI_DOUBLE, A,
                      (taskid == numtasks - 1) ? last_stripe_size : stripe_size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    perf_phase_end(&phase[PH_SCATTER]);
 
     if (taskid == 0)
         sendTime = my_ftime() - start_time_lt;  //-- ----------------- Measure send. Time
@@ -188,28 +2224,67 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Created and sent Matrices A, B and C of size %dx%d\n", size, size);
     }
 
+    // Each node reorganizes its copy of B into contiguous panels of the kernel tile width
+    double *Bp = NULL;
+    perf_phase_begin(&phase[PH_PACK]);
+    if (pack && shared) { // the ranks of a host pack distinct panels of the shared copy
+        int panels = gemm_pack_b_panels(size);
+        int p0 = block_low(nc.noderank, nc.nodesize, panels), p1 = block_low(nc.noderank + 1, nc.nodesize, panels);
+        Bp = node_shared_alloc(&nc, gemm_packed_b_size(size), &winBp);
+#pragma omp parallel for schedule(static)
+        for (i = p0; i < p1; i++)
+            gemm_pack_b_panel(size, B, Bp, i);
+        MPI_Win_fence(0, winBp);
+    } else if (pack) {
+        Bp = gemm_alloc_packed_b(size);
+#pragma omp parallel for schedule(static)
+        for (i = 0; i < gemm_pack_b_panels(size); i++)
+            gemm_pack_b_panel(size, B, Bp, i);
+    }
+    perf_phase_end(&phase[PH_PACK]);
+
+    if (taskid == 0)
+        packTime = my_ftime() - start_time_lt - sendTime;  //-- --------- Measure packing Time
+
     // Each node compute the multiplication (MPI)
     // Parallelization of multiplication on a node (OpenMP)
-#pragma omp parallel shared(A,B,C) private(i,j,k)
+    // Rows are indexed from the start of the local stripe (rank 0 has from = 0)
+    int nthreads = omp_get_max_threads();
+    double *threadTime = (double *) calloc(nthreads, sizeof(double));
+    perf_phase_begin(&phase[PH_COMPUTE]);
+#pragma omp parallel shared(A,B,Bp,C) private(i)
     {
-#pragma omp for schedule(static)
-        for (i = from; i < to; i++)
-            for (j = 0; j < size; j++) {
-                C[i * size + j] = 0;
-                for (k = 0; k < size; k++)
-                    C[i * size + j] += A[i * size + k] * B[k * size + j];
-            }
+        double t0 = omp_get_wtime();
+#pragma omp for schedule(runtime) nowait
+        for (i = 0; i < to - from; i += gemm_mc)
+            gemm_block_rows_ex(size, A, B, Bp, C, i, GEMM_MIN(i + gemm_mc, to - from));
+        threadTime[omp_get_thread_num()] = omp_get_wtime() - t0;
     }
+    perf_phase_end(&phase[PH_COMPUTE]);
 
-    // Get stripes of C from workers
     if (taskid == 0)
+        compTime = my_ftime() - start_time_lt - sendTime - packTime; //-- --------Measure computing Time
+
+    // With perf the imbalance is measured apart, otherwise it hides in the gather
+    if (perf) {
+        perf_phase_begin(&phase[PH_WAIT]);
+        MPI_Barrier(MPI_COMM_WORLD);
+        perf_phase_end(&phase[PH_WAIT]);
+    }
+
+    // Get stripes of C from workers, unless they only go to the result file
+    perf_phase_begin(&phase[PH_GATHER]);
+    if (fileC != NULL && resultFileName == NULL && !debug)
+        ;
+    else if (taskid == 0)
         MPI_Gatherv(MPI_IN_PLACE, stripe_size, MPI_DOUBLE, C, scounts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
     else
-        MPI_Gatherv(C + from * size, (taskid == numtasks - 1) ? last_stripe_size : stripe_size, MPI_DOUBLE, C, scounts,
+        MPI_Gatherv(C, (taskid == numtasks - 1) ? last_stripe_size : stripe_size, MPI_DOUBLE, C, scounts,
                     displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    perf_phase_end(&phase[PH_GATHER]);
 
     if (taskid == 0)
-        compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+        gatherTime = my_ftime() - start_time_lt - sendTime - packTime - compTime; //-- --Measure gathering Time
 
     if (taskid == 0 && debug) {
         fprintf(stderr, "A[%dx%d]:\n", size, size);
@@ -226,32 +2301,42 @@ int main(int argc, char *argv[]) {
 
     if (taskid == 0) {
         // Print and stores timing results in a file
-        printf("Times (init, send and computing) = %.4g, %.4g, %.4g sec\n\n", initTime / 1000.0, sendTime / 1000.0, compTime / 1000.0);
-        printf("size=%d\tinitTime=%g\tsendTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, initTime / 1000.0, sendTime / 1000.0, compTime / 1000.0,
-               (compTime / 1000) / 60, (compTime / 1000) % 60);
+        printf("Times (init, send, packing, computing and gathering) = %.4g, %.4g, %.4g, %.4g, %.4g sec\n\n",
+               initTime / 1000.0, sendTime / 1000.0, packTime / 1000.0, compTime / 1000.0, gatherTime / 1000.0);
+        printf("size=%d\tinitTime=%g\tsendTime=%g\tpackTime=%g\tcomputeTime=%g\tgatherTime=%g (%lu min, %lu sec)\n",
+               size, initTime / 1000.0, sendTime / 1000.0, packTime / 1000.0, compTime / 1000.0,
+               gatherTime / 1000.0, (compTime / 1000) / 60, (compTime / 1000) % 60);
     }
+    if (perf) {
+        report_phases(phase, PH_COUNT, taskid, numtasks);
+        perf_close();
+    }
+    if (verify > 0 || checksum) failed = verify_stripes(size, A, B, C, from, to, verify, checksum, taskid, numtasks);
 
     // Storage of Results and Parametres in the file resultFileName
-    if (resultFileName != NULL && taskid == 0) {
-        ++resultFileName;      // strchr points to the '=' sign
-        if (debug) fprintf(stderr, "dumping result to %s\n", resultFileName);
-        FILE *f = fopen(resultFileName, "w");
-        if (f == NULL)
-            fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
-        else {
-            dump(C, size, f);
-            fclose(f);
-        }
-    }
+    if (taskid == 0)
+        save_result(C, size, resultFileName, debug);
+    if (fileC != NULL)
+        mpiio_write_rows(fileC, size, from, to, C, taskid);
+    if (hybrid) report_thread_times(threadTime, nthreads, taskid, numtasks, debug);
+    if (rss) report_peak_rss(taskid, numtasks, debug);
     if (taskid == 0 && debug) fprintf(stderr, "Done!\n");
 
     free_real_matrix(A, size);
-    free_real_matrix(B, size);
     free_real_matrix(C, size);
+    if (shared) {
+        if (Bp != NULL) MPI_Win_free(&winBp);
+        MPI_Win_free(&winB);
+        node_free(&nc);
+    } else {
+        free_real_matrix(B, size);
+        matrix_free(Bp);
+    }
+    free(threadTime);
     free(scounts);
     free(displs);
 
     MPI_Finalize();
 
-    return 0;
+    return failed;
 }
@@ -4,8 +4,6 @@
 //  Created 20.2.2016
 //  Modification: Francois Kilchoer 2016/03/04
 
-#define sizeMatrix 2048
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +12,14 @@
 #include <limits.h>  // CLOCKS_PER_SEC
 #include <sys/timeb.h>
 
+#include "arena.h"
+#include "gemm.h"
+#include "gemmt.h"
+#include "matio.h"
+#include "bench.h"
+#include "tune.h"
+#include "verify.h"
+
 unsigned long my_ftime() { 
    struct timeval t;
 
@@ -33,12 +39,12 @@ double *free_real_matrix(double *matrix, int size) {
          matrix[i] = NULL;
       }
    #endif
-   free(matrix);       // frees the pointer /
+   matrix_free(matrix); // frees the pointer /
    return NULL;        //returns a null pointer /
 }
 
 //-- ----------------------------------------------------------------------------
-// This function allocates a square matrix using malloc, and initializes it.
+// This function allocates a square matrix (see arena.h), and initializes it in parallel.
 // if 'random' is 0, initialize matrix to all 0s
 // if 'random' is -1, it initializes the matrix with random values (0->9).
 // if 'random' is -2 the matrix is initialized with no values in it.
@@ -50,7 +56,7 @@ double *allocate_real_matrix(int size, int random) {
 
    // allocates one vector of vectors (2D array = matrix)
    //matrix = (double**) malloc(n * sizeof(double*));
-   matrix = (double*) malloc(n*n * sizeof(double));
+   matrix = matrix_alloc((size_t) n * n);  // 64 bytes aligned, from the arena if it has room
 
    if (matrix == NULL) {
       fprintf (stderr, "** Error in matrix creation: insufficient memory **");
@@ -59,10 +65,12 @@ double *allocate_real_matrix(int size, int random) {
       //return (NULL);
    }
    if (random == 0) 
+#pragma omp parallel for private(j) schedule(static)
       for (i=0; i < size; ++i)
          for (j = 0; j < m; j++)
             matrix[i*size+j] = 0;
    else if (random == -1)
+#pragma omp parallel for private(j) schedule(static)
       for (i=0; i < size; ++i)
          for (j = 0; j < m; j++)
             matrix[i*size+j] = i+1;// rand() % 10;  // Initialize with a random value between 0 and 9
@@ -75,12 +83,12 @@ double *allocate_real_matrix(int size, int random) {
 }
 
 //-- ----------------------------------------------------------------------------*/
-// Display 'size'x'size' elements of 'matrix' for debugging purposes
-void display(double *matrix, int size, int atmost) {
+// Display 'size'x'size' elements of 'matrix' (of element type 'type', see gemmt.h) for debugging purposes
+void display_typed(const void *matrix, elem_t type, int size, int atmost) {
    int i, j, limit = size < atmost ? size : atmost;
    for (i=0; i<limit; i++) {
       for (j=0; j<limit; j++)
-         fprintf(stderr, "%6.1lf ", matrix[i*size+j]);
+         fprintf(stderr, "%6.1lf ", elem_out_value(type, matrix, i*size+j));
          //printf("%6.1lf ", (double)(*matrix+(i*size+j)));
       if (atmost < size) fprintf(stderr, "...");
       fprintf(stderr, "\n");
@@ -89,19 +97,82 @@ void display(double *matrix, int size, int atmost) {
    fprintf(stderr, "\n-----------------------\n");
 }
 
+void display(double *matrix, int size, int atmost) {
+   display_typed(matrix, ELEM_F64, size, atmost);
+}
+
 // -- --------------------------------------------------------------------
-// dump matrix in binary format - simply to allow quick compare with another result file
-void dump(double *matrix, int size, FILE *f) {
-   if (fwrite(matrix, sizeof(double), size, f) != size)
+// dump the whole matrix in raw binary format - simply to allow quick compare with another result file
+void dump_typed(const void *matrix, size_t elemSize, int size, FILE *f) {
+   if (fwrite(matrix, elemSize, (size_t) size * size, f) != (size_t) size * size)
       fprintf(stderr, "Couldn't dump results to file\n");
 }
 
+void dump(double *matrix, int size, FILE *f) {
+   dump_typed(matrix, sizeof(double), size, f);
+}
+
+// -- -----------------------------------------------------------
+// C = A * B for an element type other than double (type=float|int32|mixed, see gemmt.h)
+void multiply_typed(int size, elem_t type, int debug, char *resultFileName) {
+   unsigned long start_time_lt, initTime, packTime, compTime;
+   size_t in = elem_in_size(type), out = elem_out_size(type);
+   int i;
+
+   start_time_lt =  my_ftime();  //-- -------------------------- Take starting Time
+
+   void *A = elem_alloc((size_t) size * size, in);
+   void *B = elem_alloc((size_t) size * size, in);
+   void *C = elem_alloc((size_t) size * size, out);
+   void *Bp = elem_alloc(elem_packed_size(type, size), in);
+   if (A == NULL || B == NULL || C == NULL || Bp == NULL) {
+      fprintf (stderr, "** Error in matrix creation: insufficient memory **");
+      fprintf (stderr, "** Program aborted................................ **");
+      exit(1) ;
+   }
+   elem_fill(type, A, size, 0, size);
+   elem_fill(type, B, size, 0, size);
+
+   initTime = my_ftime() - start_time_lt;  //-- ----------------- Measure init. Time
+
+   for (i = 0; i < elem_pack_panels(type, size); i++)
+      elem_pack_panel(type, size, B, Bp, i);
+
+   packTime = my_ftime() - start_time_lt - initTime;  //-- --------- Measure packing Time
+
+   elem_rows(type, size, A, Bp, C, 0, size);
+
+   compTime = my_ftime() - start_time_lt - initTime - packTime; //-- --------Measure computing Time
+
+   printf("Times (init, packing and computing) = %.4g, %.4g, %.4g sec\n\n",
+                                             initTime/1000.0, packTime/1000.0, compTime/1000.0);
+   printf("size=%d\ttype=%s\tinitTime=%g\tpackTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, elem_names[type],
+          initTime/1000.0, packTime/1000.0, compTime/1000.0,
+          (compTime/1000)/60, (compTime/1000)%60);
+   if (debug) { fprintf(stderr, "C[%dx%d]=A*B:\n", size, size); display_typed(C, type, size, size < 100? size:100);}
+
+   if (resultFileName!=NULL) {
+      ++resultFileName;      // strchr points to the '=' sign
+      FILE* f = fopen(resultFileName, "w");
+      if (f == NULL)
+         fprintf(stderr, "\nERROR OPENING result file - no results are saved !!\n");
+      else {
+         dump_typed(C, out, size, f);
+         fclose(f);
+      }
+   }
+}
+
 // -- -----------------------------------------------------------
 int main (int argc, char* argv[]) {
-   int size, debug=0;
-   unsigned long start_time_lt, initTime, compTime;
+   int size=0, debug=0, pack=1, huge=0, type=ELEM_F64, naive=0, reps=0, warmup=1, json=0, verify=0, checksum=0;
+   char *benchFile = NULL;
+   unsigned long start_time_lt, initTime, packTime, compTime;
    char* resultFileName = NULL;
-   register int i, j, k;
+   char *fileA = NULL, *fileB = NULL, *fileC = NULL;  // matrix files, see matio.h
+   matio_map_t mapA = {0}, mapB = {0}, mapC = {0};
+   matio_header_t hdr;
+   register int k;
 
    // rudimentary argument collecting
    for (k=1; k < argc; ++k) {
@@ -109,40 +180,121 @@ int main (int argc, char* argv[]) {
          size = atoi(argv[k]);
       else if (strncmp(argv[k], "dump", 4) == 0) // assume dump=filename 
          resultFileName=strchr(argv[k],'=');
+      else if (strcmp(argv[k], "nopack") == 0)   // multiply B in place, no packing
+         pack = 0;
+      else if (strcmp(argv[k], "naive") == 0)    // original triple loop (benchmark baseline)
+         naive = 1;
+      else if (strncmp(argv[k], "verify", 6) == 0) // verify or verify=rounds: Freivalds check of C
+         verify = argv[k][6] == '=' ? atoi(argv[k] + 7) : 1;
+      else if (strcmp(argv[k], "checksum") == 0) // checksum of C against the one expected from A and B
+         checksum = 1;
+      else if (bench_option(argv[k], &reps, &warmup, &benchFile, &json)) // bench=, warmup=, csv=, json=
+         ;
+      else if (strcmp(argv[k], "huge") == 0)     // back the matrices with 2 MB pages
+         huge = 1;
+      else if (strncmp(argv[k], "A=", 2) == 0)   // read A from a matrix file
+         fileA = argv[k] + 2;
+      else if (strncmp(argv[k], "B=", 2) == 0)   // read B from a matrix file
+         fileB = argv[k] + 2;
+      else if (strncmp(argv[k], "out=", 4) == 0) // write C to a matrix file
+         fileC = argv[k] + 4;
+      else if (strncmp(argv[k], "type=", 5) == 0) { // element type: double, float, int32 or mixed
+         if ((type = elem_parse(argv[k] + 5)) < 0) {
+            fprintf(stderr, "** Unknown element type %s **\n", argv[k] + 5);
+            exit(1);
+         }
+      }
       else if (debug=strncmp(argv[k], "debug", 5) == 0) // want debuging info
          fprintf(stderr, "debug is now on.\n");
    }
 
+   // Operands read from files give the size
+   if ((fileA != NULL && matio_square_size(fileA, &size) != 0) || (fileB != NULL && matio_square_size(fileB, &size) != 0))
+      exit(1);
+   if ((verify > 0 || checksum) && (type != ELEM_F64 || reps > 0)) {
+      fprintf(stderr, "** verify and checksum check a single double product **\n");
+      exit(1);
+   }
+
    if (debug) fprintf(stderr, "\nStart sequential standard algorithm (size=%d)...\n", size);
 
+   const gemm_kernel_t *kern = gemm_init();
+   if (debug) fprintf(stderr, "Using %s micro kernel (%dx%d)\n", kern->name, kern->mr, kern->nr);
+
+   tune_config_t tuned;   // block sizes cached for this host (MOMP tune)
+   tune_load(&tuned, 0, debug);
+
    start_time_lt =  my_ftime();  //-- -------------------------- Take starting Time
 
-   register double* A=allocate_real_matrix(size, -1);
-   register double* B=allocate_real_matrix(size, -1);
-   register double* C=allocate_real_matrix(size, -2);
+   // One arena for A, B, C and the packed copy of B
+   arena_init(3 * arena_bytes((size_t) size * size) + arena_bytes(gemm_packed_b_size(size)), huge);
 
+   if (type != ELEM_F64) {
+      if (fileA != NULL || fileB != NULL || fileC != NULL) {
+         fprintf(stderr, "** Matrix files only hold doubles **\n");
+         exit(1);
+      }
+      multiply_typed(size, type, debug, resultFileName);
+      return 0;
+   }
+
+   register double* A=fileA != NULL ? matio_map_read(fileA, &hdr, &mapA) : allocate_real_matrix(size, -1);
+   register double* B=fileB != NULL ? matio_map_read(fileB, &hdr, &mapB) : allocate_real_matrix(size, -1);
+   register double* C=fileC != NULL ? matio_map_create(fileC, size, size, &mapC) : allocate_real_matrix(size, -2);
+
+   if (A == NULL || B == NULL || C == NULL) exit(1);  // matrix file errors are already reported
    if (debug) fprintf(stderr, "Created Matrices A, B and C of size %dx%d\n", size, size);
 
    initTime = my_ftime() - start_time_lt;  //-- ----------------- Measure init. Time
 
-   for (i=0; i<size; i++)
-      for (j=0; j<size; j++) {
-         C[i*size+j] = 0;
-         for (k=0; k<size; k++)
-            C[i*size+j] += A[i*size + k] * B[k*size+j];
+   if (reps > 0) {  // benchmark: 'warmup' untimed runs, then 'reps' timed multiplies (packing included)
+      bench_record_t rec = {"MStandard", naive ? "naive" : pack ? "packed" : "blocked", "double", size, 1, 1, warmup, reps};
+      double samples[BENCH_MAX_REPS], t;
+      double* Bp = pack && !naive ? gemm_alloc_packed_b(size) : NULL;
+      int r;
+
+      for (r = -warmup; r < reps; r++) {
+         t = bench_now();
+         if (naive)
+            gemm_naive_rows(size, A, B, C, 0, size);
+         else {
+            if (pack) gemm_pack_b(size, B, Bp);
+            gemm_block_rows_ex(size, A, B, Bp, C, 0, size);
+         }
+         if (r >= 0) samples[r] = bench_now() - t;
       }
+      bench_stats(&rec, samples, 1);
+      bench_report(&rec, benchFile, json);
+      return 0;
+   }
+
+   // Reorganize B into contiguous panels of the kernel tile width
+   double* Bp = NULL;
+   if (pack && !naive) {
+      Bp = gemm_alloc_packed_b(size);
+      gemm_pack_b(size, B, Bp);
+   }
+
+   packTime = my_ftime() - start_time_lt - initTime;  //-- --------- Measure packing Time
+
+   if (naive)
+      gemm_naive_rows(size, A, B, C, 0, size);
+   else
+      gemm_block_rows_ex(size, A, B, Bp, C, 0, size);
 
-   compTime = my_ftime() - start_time_lt - initTime; //-- --------Measure computing Time
+   compTime = my_ftime() - start_time_lt - initTime - packTime; //-- --------Measure computing Time
    if (debug) { fprintf(stderr, "A[%dx%d]:\n", size, size); display(A, size, size < 100? size:100); }
    if (debug) { fprintf(stderr, "B[%dx%d]:\n", size, size); display(B, size, size < 100? size:100); }
 
 
    // Print and stores timing results in a file
-   printf("Times (init and computing) = %.4g, %.4g sec\n\n",
-                                             initTime/1000.0, compTime/1000.0);
-   printf("size=%d\tinitTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, initTime/1000.0, compTime/1000.0,
+   printf("Times (init, packing and computing) = %.4g, %.4g, %.4g sec\n\n",
+                                             initTime/1000.0, packTime/1000.0, compTime/1000.0);
+   printf("size=%d\tinitTime=%g\tpackTime=%g\tcomputeTime=%g (%lu min, %lu sec)\n", size, initTime/1000.0,
+          packTime/1000.0, compTime/1000.0,
           (compTime/1000)/60, (compTime/1000)%60);
    if (debug) { fprintf(stderr, "C[%dx%d]=A*B:\n", size, size); display(C, size, size < 100? size:100);}
+   int failed = verify_product(size, A, B, C, verify, checksum);
 
    // Storage of Results and Parametres in the file resultFileName
    if (resultFileName!=NULL) {
@@ -157,5 +309,9 @@ int main (int argc, char* argv[]) {
       }
    }
    if (debug) fprintf(stderr, "Done!\n");
-   return 0;
+   matrix_free(Bp);
+   matio_unmap(&mapA);
+   matio_unmap(&mapB);
+   matio_unmap(&mapC);  // C is written back to its file
+   return failed;
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+//-- ----------------------------------------------------------------------------*/
+//  Aligned matrix allocator backed by one arena
+//  Created 16.10.2026
+//
+//  Every matrix is 64 bytes aligned (one cache line, one AVX-512 vector).
+//  The drivers reserve one arena at startup big enough for A, B, C and the
+//  scratch buffers; matrix_alloc carves matrices out of it and falls back to
+//  aligned malloc when it is full. With 'huge' the arena is 2 MB aligned and
+//  madvise'd for transparent huge pages, which cuts the TLB misses of the
+//  column walk over B. Reserving does not touch the pages: only the memory
+//  actually used counts in the resident set.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define MATRIX_ALIGN 64
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+#define ARENA_ROUND(bytes, align) (((bytes) + (align) - 1) / (align) * (align))
+
+typedef struct {
+    char *base;
+    size_t size, used;
+    int huge;
+} arena_t;
+
+static arena_t matrix_arena = {NULL, 0, 0, 0};
+
+//-- ----------------------------------------------------------------------------
+// Allocate 'bytes' outside the arena, 64 bytes aligned, or 2 MB aligned and
+// advised for huge pages if 'huge' is set and the block spans one at least.
+static void *aligned_block(size_t bytes, int huge) {
+    void *block = NULL;
+    int hp = huge && bytes >= HUGE_PAGE_SIZE;
+
+    if (posix_memalign(&block, hp ? HUGE_PAGE_SIZE : MATRIX_ALIGN, hp ? ARENA_ROUND(bytes, HUGE_PAGE_SIZE) : bytes) != 0)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    if (hp) madvise(block, ARENA_ROUND(bytes, HUGE_PAGE_SIZE), MADV_HUGEPAGE);
+#endif
+    return block;
+}
+
+//-- ----------------------------------------------------------------------------
+// Reserve the arena. Calling it again releases the previous one.
+static void arena_init(size_t bytes, int huge) {
+    free(matrix_arena.base);
+    matrix_arena.huge = huge;
+    matrix_arena.used = 0;
+    matrix_arena.size = huge ? ARENA_ROUND(bytes, HUGE_PAGE_SIZE) : bytes;
+    matrix_arena.base = (char *) aligned_block(matrix_arena.size, huge);
+    if (matrix_arena.base == NULL) matrix_arena.size = 0;  // matrix_alloc falls back to malloc
+}
+
+// Bytes of arena needed by 'count' doubles (each allocation stays aligned)
+static size_t arena_bytes(size_t count) {
+    return ARENA_ROUND(count * sizeof(double), MATRIX_ALIGN);
+}
+
+//-- ----------------------------------------------------------------------------
+// 'count' doubles, 64 bytes aligned, from the arena if it has room left.
+// Returns NULL if the memory is exhausted.
+static double *matrix_alloc(size_t count) {
+    size_t bytes = arena_bytes(count);
+    double *matrix = NULL;
+
+#pragma omp critical (matrix_arena)
+    if (matrix_arena.used + bytes <= matrix_arena.size) {
+        matrix = (double *) (matrix_arena.base + matrix_arena.used);
+        matrix_arena.used += bytes;
+    }
+    if (matrix == NULL) matrix = (double *) aligned_block(bytes, matrix_arena.huge);
+    return matrix;
+}
+
+// Allocate 'count' doubles outside the arena (short-lived scratch, free with free())
+static inline double *matrix_alloc_heap(size_t count) {
+    return (double *) aligned_block(arena_bytes(count), matrix_arena.huge);
+}
+
+//-- ----------------------------------------------------------------------------
+// Release a matrix; memory of the arena is only reclaimed by the next arena_init
+static void matrix_free(void *matrix) {
+    char *p = (char *) matrix;
+
+    if (p >= matrix_arena.base && p < matrix_arena.base + matrix_arena.size) return;
+    free(matrix);
+}
+
+#endif // ARENA_H
@@ -0,0 +1,110 @@
+//-- ----------------------------------------------------------------------------*/
+//  Batched multiplication of many small matrices
+//  Created 16.10.2026
+//
+//  C_p = A_p * B_p for 'count' independent pairs of 'n'x'n' row-major
+//  matrices stored one after the other in contiguous buffers (pair p starts
+//  at p * n * n). The batch is split across the OpenMP threads; each product
+//  runs whole on one thread. The common small sizes (4, 8, 16, 32, 64) have
+//  kernels with a constant size, fully unrolled and vectorized by the
+//  compiler, with one row of C kept in registers. Other sizes up to
+//  BATCH_BLOCKED use the same loop with a variable size, larger ones the
+//  blocked kernel of gemm.h.
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "gemm.h"
+#include "gemmt.h"      // GEMMT_CLONES
+
+#define BATCH_BLOCKED 96    // from this size on the blocked kernel is faster
+
+typedef void (*batch_kernel_fn)(int n, const double *A, const double *B, double *C);
+
+//-- ----------------------------------------------------------------------------
+// Kernel for the constant size N (the 'n' argument is ignored)
+#define BATCH_KERNEL(N)                                                                   \
+    GEMMT_CLONES static void batch_kernel_##N(int n, const double *A, const double *B,    \
+                                              double *C) {                                \
+        int i, j, k;                                                                      \
+        (void) n;                                                                         \
+        for (i = 0; i < N; i++) {                                                         \
+            double c[N];                                                                  \
+            for (j = 0; j < N; j++) c[j] = 0;                                             \
+            for (k = 0; k < N; k++) {                                                     \
+                double a = A[i * N + k];                                                  \
+                _Pragma("omp simd")                                                       \
+                for (j = 0; j < N; j++) c[j] += a * B[k * N + j];                         \
+            }                                                                             \
+            for (j = 0; j < N; j++) C[i * N + j] = c[j];                                  \
+        }                                                                                 \
+    }
+
+BATCH_KERNEL(4)
+BATCH_KERNEL(8)
+BATCH_KERNEL(16)
+BATCH_KERNEL(32)
+BATCH_KERNEL(64)
+
+// Any size below BATCH_BLOCKED
+GEMMT_CLONES static void batch_kernel_any(int n, const double *A, const double *B, double *C) {
+    int i, j, k;
+
+    for (i = 0; i < n; i++) {
+        double *c = C + (long) i * n;
+        for (j = 0; j < n; j++) c[j] = 0;
+        for (k = 0; k < n; k++) {
+            double a = A[(long) i * n + k];
+#pragma omp simd
+            for (j = 0; j < n; j++) c[j] += a * B[(long) k * n + j];
+        }
+    }
+}
+
+// Large sizes: blocked kernel, B read in place (packing does not pay off for one product)
+static void batch_kernel_blocked(int n, const double *A, const double *B, double *C) {
+    memset(C, 0, (size_t) n * n * sizeof(double));
+    gemm_blocked(n, n, n, A, n, B, n, NULL, C, n);
+}
+
+//-- ----------------------------------------------------------------------------
+// Kernel used for the size 'n'
+static batch_kernel_fn batch_kernel(int n) {
+    switch (n) {
+    case 4: return batch_kernel_4;
+    case 8: return batch_kernel_8;
+    case 16: return batch_kernel_16;
+    case 32: return batch_kernel_32;
+    case 64: return batch_kernel_64;
+    }
+    return n < BATCH_BLOCKED ? batch_kernel_any : batch_kernel_blocked;
+}
+
+//-- ----------------------------------------------------------------------------
+// C_p = A_p * B_p for p = 0..'count'-1, in parallel over the batch
+static void batch_multiply(int n, long count, const double *A, const double *B, double *C) {
+    batch_kernel_fn kern = batch_kernel(n);
+    long nn = (long) n * n, p;
+
+    gemm_init();    // before the parallel region
+#pragma omp parallel for schedule(static)
+    for (p = 0; p < count; p++)
+        kern(n, A + p * nn, B + p * nn, C + p * nn);
+}
+
+//-- ----------------------------------------------------------------------------
+// Fill the pairs 'first'..'first'+'count'-1 of a batch: A_p[i][j] = i + 1 and
+// B_p[i][j] = p % 10 + 1, so C_p[i][j] = (i + 1) * n * (p % 10 + 1).
+// 'A' and 'B' point to pair 'first'.
+static void batch_fill(int n, long first, long count, double *A, double *B) {
+    long nn = (long) n * n, p, e;
+
+#pragma omp parallel for private(e) schedule(static)
+    for (p = 0; p < count; p++)
+        for (e = 0; e < nn; e++) {
+            A[p * nn + e] = e / n + 1;
+            B[p * nn + e] = (first + p) % 10 + 1;
+        }
+}
+
+#endif // BATCH_H
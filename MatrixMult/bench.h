@@ -0,0 +1,146 @@
+//-- ----------------------------------------------------------------------------*/
+//  Benchmark harness shared by the drivers (bench=<reps> option)
+//  Created 16.10.2026
+//
+//  Times are taken with the monotonic clock (nanosecond resolution, not
+//  affected by NTP adjustments); MPI_Wtime is used in MParallel. After
+//  'warmup' untimed runs the multiply is repeated 'reps' times; median,
+//  mean, standard deviation and minimum are reported together with the
+//  GFLOP/s of the median (2*n^3 flops) and its percentage of the peak. Each
+//  run appends one record per configuration to a CSV file (csv=file, header
+//  written when the file is empty) or a JSON Lines file (json=file, one
+//  object per line), for plotting sweeps.
+//
+//  The peak is cores x clock x double flops per cycle of the selected micro
+//  kernel (2 FMA units: 32 for AVX-512, 16 for AVX2, 2 for scalar code); set
+//  BENCH_PEAK_GFLOPS to the real per-core figure of the host when known.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <math.h>
+#include <time.h>
+#include "gemm.h"
+
+#define BENCH_MAX_REPS 1000
+
+typedef struct {
+    const char *driver;         // MStandard, MOMP or MParallel
+    const char *kernel;         // naive, blocked, packed, dynamic, strassen, stripe...
+    const char *elem;           // element type
+    int size, ranks, threads, warmup, reps;
+    double median, mean, stddev, min;
+    double gflops, peak, pctPeak;
+} bench_record_t;
+
+//-- ----------------------------------------------------------------------------
+// Monotonic time in seconds
+static inline double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+//-- ----------------------------------------------------------------------------
+// Peak GFLOP/s of one core: BENCH_PEAK_GFLOPS, or the clock of /proc/cpuinfo
+// times the flops per cycle of the micro kernel
+static double bench_core_peak(void) {
+    const char *env = getenv("BENCH_PEAK_GFLOPS");
+    const gemm_kernel_t *kern = gemm_init();
+    double mhz = 0, flops = strcmp(kern->name, "avx512") == 0 ? 32 : strcmp(kern->name, "avx2") == 0 ? 16 : 2;
+    char line[256];
+    FILE *f;
+
+    if (env != NULL) return atof(env);
+    if ((f = fopen("/proc/cpuinfo", "r")) != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL)
+            if (strncmp(line, "cpu MHz", 7) == 0 && sscanf(strchr(line, ':') + 1, "%lf", &mhz) == 1) break;
+        fclose(f);
+    }
+    return mhz * 1e-3 * flops;
+}
+
+// Collect the benchmark options: bench=<reps>, warmup=<runs>, csv=<file> and
+// json=<file>. Returns 1 if 'arg' was one of them.
+static int bench_option(const char *arg, int *reps, int *warmup, char **path, int *json) {
+    if (strncmp(arg, "bench=", 6) == 0) {
+        *reps = atoi(arg + 6);
+        if (*reps < 1 || *reps > BENCH_MAX_REPS) {
+            fprintf(stderr, "** bench=<reps> expects 1..%d repetitions **\n", BENCH_MAX_REPS);
+            exit(1);
+        }
+    } else if (strncmp(arg, "warmup=", 7) == 0) {
+        *warmup = atoi(arg + 7);
+        if (*warmup < 0) {
+            fprintf(stderr, "** warmup=<runs> expects 0 or more runs **\n");
+            exit(1);
+        }
+    } else if (strncmp(arg, "csv=", 4) == 0) {
+        *path = (char *) arg + 4;
+        *json = 0;
+    } else if (strncmp(arg, "json=", 5) == 0) {
+        *path = (char *) arg + 5;
+        *json = 1;
+    } else
+        return 0;
+    return 1;
+}
+
+//-- ----------------------------------------------------------------------------
+// Fill the statistics of 'rec' from the 'reps' times of 'samples' (sorted in
+// place); 'cores' is the number of cores used, for the peak
+static void bench_stats(bench_record_t *rec, double *samples, int cores) {
+    int r, n = rec->reps;
+    double sum = 0, var = 0;
+
+    qsort(samples, n, sizeof(double), bench_cmp);
+    for (r = 0; r < n; r++) sum += samples[r];
+    rec->mean = sum / n;
+    for (r = 0; r < n; r++) var += (samples[r] - rec->mean) * (samples[r] - rec->mean);
+    rec->stddev = n > 1 ? sqrt(var / (n - 1)) : 0;
+    rec->median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    rec->min = samples[0];
+    rec->gflops = rec->median > 0 ? 2.0 * rec->size * rec->size * rec->size / rec->median * 1e-9 : 0;
+    rec->peak = bench_core_peak() * cores;
+    rec->pctPeak = rec->peak > 0 ? 100 * rec->gflops / rec->peak : 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Print 'rec' on stdout and append it to 'path' (CSV, or JSON Lines if
+// 'json' is set); 'path' may be NULL
+static void bench_report(const bench_record_t *rec, const char *path, int json) {
+    FILE *f;
+
+    printf("bench\t%s\t%s\t%s\tsize=%d\tranks=%d\tthreads=%d\treps=%d\tmedian=%.6g\tmean=%.6g\tstddev=%.3g\t"
+           "min=%.6g\tGFLOPS=%.2f\tpeak=%.1f\tpctPeak=%.1f\n", rec->driver, rec->kernel, rec->elem, rec->size,
+           rec->ranks, rec->threads, rec->reps, rec->median, rec->mean, rec->stddev, rec->min, rec->gflops,
+           rec->peak, rec->pctPeak);
+    if (path == NULL) return;
+    if ((f = fopen(path, "a")) == NULL) {
+        fprintf(stderr, "\nERROR OPENING benchmark file %s - no results are saved !!\n", path);
+        return;
+    }
+    if (json)
+        fprintf(f, "{\"driver\":\"%s\",\"kernel\":\"%s\",\"type\":\"%s\",\"size\":%d,\"ranks\":%d,\"threads\":%d,"
+                   "\"warmup\":%d,\"reps\":%d,\"median\":%.9g,\"mean\":%.9g,\"stddev\":%.9g,\"min\":%.9g,"
+                   "\"gflops\":%.4f,\"peak\":%.4f,\"pctPeak\":%.3f}\n", rec->driver, rec->kernel, rec->elem,
+                rec->size, rec->ranks, rec->threads, rec->warmup, rec->reps, rec->median, rec->mean, rec->stddev,
+                rec->min, rec->gflops, rec->peak, rec->pctPeak);
+    else {
+        fseek(f, 0, SEEK_END);
+        if (ftell(f) == 0)
+            fprintf(f, "driver,kernel,type,size,ranks,threads,warmup,reps,median,mean,stddev,min,gflops,peak,pctPeak\n");
+        fprintf(f, "%s,%s,%s,%d,%d,%d,%d,%d,%.9g,%.9g,%.9g,%.9g,%.4f,%.4f,%.3f\n", rec->driver, rec->kernel,
+                rec->elem, rec->size, rec->ranks, rec->threads, rec->warmup, rec->reps, rec->median, rec->mean,
+                rec->stddev, rec->min, rec->gflops, rec->peak, rec->pctPeak);
+    }
+    fclose(f);
+}
+
+#endif // BENCH_H
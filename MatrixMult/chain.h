@@ -0,0 +1,363 @@
+//-- ----------------------------------------------------------------------------*/
+//  Matrix chains and powers (chain= and power= options)
+//  Created 16.10.2026
+//
+//  A chain A_0 * A_1 * ... * A_{n-1} (A_t is dims[t] x dims[t+1]) is
+//  multiplied in the order of least flops, found by the classic dynamic
+//  program on the dimensions. chain_plan only records that order;
+//  chain_eval then walks the tree lazily: each intermediate is computed
+//  right before its parent needs it, into a buffer of a small pool, and
+//  goes back to the pool as soon as the parent is computed. The root is
+//  written straight into the result. A^k is computed by repeated squaring
+//  (log2(k) squarings and popcount(k) - 1 products instead of k - 1).
+//  The rows of every matrix may be distributed: a chain holds the rows of
+//  block 'part' of 'parts' (the rank, see MParallel) of the factors and of
+//  the intermediates, and the right operand of each product is made whole
+//  by the 'whole' hook of the driver. Nothing goes to one rank between two
+//  products.
+
+#ifndef CHAIN_H
+#define CHAIN_H
+
+#include "gemm.h"
+#include "verify.h"
+
+#define CHAIN_MAX 32                // factors of a chain
+#define CHAIN_POOL (CHAIN_MAX + 2)  // scratch buffers: intermediates alive at once, and the whole operand
+
+// Copy the rows held here ('local') of a 'rows'x'cols' matrix distributed by
+// rows into the whole matrix 'whole', and return it
+typedef const double *(*chain_whole_fn)(const double *local, int rows, int cols, double *whole);
+
+typedef struct {
+    double *buf[CHAIN_POOL];
+    size_t cap[CHAIN_POOL];
+    int busy[CHAIN_POOL];
+} chain_pool_t;
+
+typedef struct {
+    int n;                              // factors (1 for a power)
+    int power;                          // k of A^k, 0 for a chain
+    int dims[CHAIN_MAX + 1];            // factor t is dims[t] x dims[t+1]
+    const double *factor[CHAIN_MAX];    // rows held here of every factor (set by the driver)
+    int split[CHAIN_MAX][CHAIN_MAX];    // product i..j = (i..split) * (split+1..j)
+    double cost[CHAIN_MAX][CHAIN_MAX];  // multiply-adds of the best order of i..j
+    int part, parts;                    // rows held: block 'part' of 'parts'
+    chain_whole_fn whole;               // NULL if every matrix is held whole
+    chain_pool_t pool;
+    long products;                      // products computed by chain_eval
+    double flops;                       // and their flops (over all parts)
+} chain_t;
+
+//-- ----------------------------------------------------------------------------
+// First row of block 'part' when 'm' rows are split into 'parts' nearly equal blocks
+static int chain_low(int part, int parts, int m) {
+    return part * (m / parts) + (part < m % parts ? part : m % parts);
+}
+
+// Rows held here of a matrix of 'm' rows
+static int chain_rows(const chain_t *ch, int m) {
+    return chain_low(ch->part + 1, ch->parts, m) - chain_low(ch->part, ch->parts, m);
+}
+
+//-- ----------------------------------------------------------------------------
+// Dimensions of chain=p0xp1x...xpn: returns the number of factors, or -1
+static int chain_parse(const char *spec, int *dims) {
+    int n = 0;
+    char *end;
+
+    for (;;) {
+        long d = strtol(spec, &end, 10);
+        if (end == spec || d <= 0 || d > INT_MAX || n > CHAIN_MAX) return -1;
+        dims[n++] = (int) d;
+        if (*end == '\0') break;
+        if (*end != 'x') return -1;
+        spec = end + 1;
+    }
+    return n >= 2 ? n - 1 : -1;
+}
+
+// Empty chain whose matrices are distributed by rows over 'parts' (1: not distributed)
+static void chain_init(chain_t *ch, int part, int parts, chain_whole_fn whole) {
+    memset(ch, 0, sizeof(*ch));
+    ch->part = part;
+    ch->parts = parts;
+    ch->whole = whole;
+}
+
+//-- ----------------------------------------------------------------------------
+// Best order of the chain of 'n' factors of dimensions 'dims' (n + 1 values)
+static void chain_plan(chain_t *ch, int n, const int *dims) {
+    int len, i, j, s;
+
+    ch->n = n;
+    ch->power = 0;
+    memcpy(ch->dims, dims, (n + 1) * sizeof(int));
+    for (i = 0; i < n; i++)
+        ch->cost[i][i] = 0;
+    for (len = 2; len <= n; len++)
+        for (i = 0; i + len - 1 < n; i++) {
+            j = i + len - 1;
+            ch->cost[i][j] = -1;
+            for (s = i; s < j; s++) {
+                double c = ch->cost[i][s] + ch->cost[s + 1][j] + (double) dims[i] * dims[s + 1] * dims[j + 1];
+                if (ch->cost[i][j] < 0 || c < ch->cost[i][j]) {
+                    ch->cost[i][j] = c;
+                    ch->split[i][j] = s;
+                }
+            }
+        }
+}
+
+// A^k for the 'size'x'size' A (factor[0])
+static void chain_plan_power(chain_t *ch, int size, int k) {
+    ch->n = 1;
+    ch->power = k;
+    ch->dims[0] = ch->dims[1] = size;
+}
+
+// Flops of the planned order, and ('left') of the left to right order
+static double chain_flops(const chain_t *ch, int left) {
+    double f = 0;
+    int t;
+
+    if (ch->power > 0) {  // squarings, then the products of the set bits
+        for (t = ch->power; t > 1; t >>= 1)
+            f += 1 + (t & 1);
+        if (left) f = ch->power - 1;
+        return 2.0 * f * ch->dims[0] * ch->dims[0] * ch->dims[0];
+    }
+    if (!left) return 2 * ch->cost[0][ch->n - 1];
+    for (t = 1; t < ch->n; t++)
+        f += (double) ch->dims[0] * ch->dims[t] * ch->dims[t + 1];
+    return 2 * f;
+}
+
+// Order of the products i..j as text, e.g. ((A0A1)A2)
+static void chain_format_range(const chain_t *ch, int i, int j, char *s, size_t len) {
+    size_t used = strlen(s);
+
+    if (used + 1 >= len) return;
+    if (i == j) {
+        snprintf(s + used, len - used, "A%d", i);
+        return;
+    }
+    snprintf(s + used, len - used, "(");
+    chain_format_range(ch, i, ch->split[i][j], s, len);
+    chain_format_range(ch, ch->split[i][j] + 1, j, s, len);
+    used = strlen(s);
+    snprintf(s + used, len - used, ")");
+}
+
+static void chain_format(const chain_t *ch, char *s, size_t len) {
+    s[0] = '\0';
+    if (ch->power > 0)
+        snprintf(s, len, "A0^%d", ch->power);
+    else
+        chain_format_range(ch, 0, ch->n - 1, s, len);
+}
+
+//-- ----------------------------------------------------------------------------
+// Idle scratch buffer of at least 'count' doubles: the smallest one that is
+// large enough, else the largest idle one grown, else a new one
+static double *chain_buffer(chain_t *ch, size_t count) {
+    chain_pool_t *p = &ch->pool;
+    int b, best = -1, grow = -1, empty = -1;
+
+    for (b = 0; b < CHAIN_POOL; b++) {
+        if (p->busy[b]) continue;
+        if (p->buf[b] == NULL) {
+            if (empty < 0) empty = b;
+        } else if (p->cap[b] >= count) {
+            if (best < 0 || p->cap[b] < p->cap[best]) best = b;
+        } else if (grow < 0 || p->cap[b] > p->cap[grow])
+            grow = b;
+    }
+    if (best < 0) {
+        best = grow >= 0 ? grow : empty;
+        if (best < 0) {
+            fprintf(stderr, "** Error in chain evaluation: no scratch buffer left **");
+            fprintf(stderr, "** Program aborted................................ **");
+            exit(1);
+        }
+        free(p->buf[best]);
+        p->buf[best] = matrix_alloc_heap(count > 0 ? count : 1);
+        p->cap[best] = count;
+        if (p->buf[best] == NULL) {
+            fprintf(stderr, "** Error in chain evaluation: insufficient memory **");
+            fprintf(stderr, "** Program aborted................................ **");
+            exit(1);
+        }
+    }
+    p->busy[best] = 1;
+    return p->buf[best];
+}
+
+// Give a buffer back to the pool (factors and results are ignored)
+static void chain_release(chain_t *ch, const double *m) {
+    int b;
+
+    for (b = 0; b < CHAIN_POOL; b++)
+        if (ch->pool.buf[b] == m) ch->pool.busy[b] = 0;
+}
+
+static void chain_free(chain_t *ch) {
+    int b;
+
+    for (b = 0; b < CHAIN_POOL; b++)
+        free(ch->pool.buf[b]);
+    memset(&ch->pool, 0, sizeof(ch->pool));
+}
+
+//-- ----------------------------------------------------------------------------
+// Rows held here of C = L * R (L is MxK, R KxN, both distributed by rows):
+// R is made whole in a scratch buffer first if the matrices are distributed
+static void chain_product(chain_t *ch, const double *L, const double *R, double *C, int M, int N, int K) {
+    double *scratch = NULL;
+
+    if (ch->whole != NULL) {
+        scratch = chain_buffer(ch, (size_t) K * N);
+        R = ch->whole(R, K, N, scratch);
+    }
+    gemm_ex(0, 0, chain_rows(ch, M), N, K, 1, L, K, R, N, 0, C, N);
+    if (scratch != NULL) chain_release(ch, scratch);
+    ch->products++;
+    ch->flops += 2.0 * M * N * K;
+}
+
+// Product i..j into 'out', or into a pool buffer if 'out' is NULL (a single
+// factor is returned as is)
+static const double *chain_eval_range(chain_t *ch, int i, int j, double *out) {
+    const double *L, *R;
+    double *C;
+    int s;
+
+    if (i == j) return ch->factor[i];
+    s = ch->split[i][j];
+    L = chain_eval_range(ch, i, s, NULL);
+    R = chain_eval_range(ch, s + 1, j, NULL);
+    C = out != NULL ? out : chain_buffer(ch, (size_t) chain_rows(ch, ch->dims[i]) * ch->dims[j + 1]);
+    chain_product(ch, L, R, C, ch->dims[i], ch->dims[j + 1], ch->dims[s + 1]);
+    chain_release(ch, L);
+    chain_release(ch, R);
+    return C;
+}
+
+// A^k by repeated squaring into 'out'
+static void chain_eval_power(chain_t *ch, double *out) {
+    int size = ch->dims[0], k = ch->power;
+    size_t count = (size_t) chain_rows(ch, size) * size;
+    const double *base = ch->factor[0], *result = NULL;
+    double *t;
+
+    for (;;) {
+        if (k & 1) {
+            if (result == NULL)
+                result = base;
+            else {
+                t = chain_buffer(ch, count);
+                chain_product(ch, result, base, t, size, size, size);
+                if (result != base) chain_release(ch, result);
+                result = t;
+            }
+        }
+        k >>= 1;
+        if (k == 0) break;
+        t = chain_buffer(ch, count);
+        chain_product(ch, base, base, t, size, size, size);
+        if (base != result) chain_release(ch, base);
+        base = t;
+    }
+    memcpy(out, result, count * sizeof(double));
+    chain_release(ch, result);
+    if (base != result) chain_release(ch, base);
+}
+
+// Rows held here of the product of the chain (or of the power) into 'C'
+static void chain_eval(chain_t *ch, double *C) {
+    if (ch->power > 0)
+        chain_eval_power(ch, C);
+    else if (ch->n == 1)
+        memcpy(C, ch->factor[0], (size_t) chain_rows(ch, ch->dims[0]) * ch->dims[1] * sizeof(double));
+    else
+        chain_eval_range(ch, 0, ch->n - 1, C);
+}
+
+//-- ----------------------------------------------------------------------------
+// Freivalds check of the rows held here of the product C: A_0 * (... * (A_{n-1} * x))
+// against C * x, one factor at a time (A applied k times for a power). Returns
+// the largest relative error over the local rows (see verify.h).
+static double chain_freivalds(chain_t *ch, const double *C, int rounds, unsigned long seed) {
+    int factors = ch->power > 0 ? ch->power : ch->n, maxDim = 0, t, r, i, k;
+    int row0 = chain_low(ch->part, ch->parts, ch->dims[0]), rows = chain_rows(ch, ch->dims[0]);
+    double *x, *y, *yabs, *z, *zabs, maxErr = 0;
+
+    for (t = 0; t <= ch->n; t++)
+        if (ch->dims[t] > maxDim) maxDim = ch->dims[t];
+    x = (double *) malloc(5 * (size_t) maxDim * sizeof(double));
+    if (x == NULL) {
+        fprintf(stderr, "** Error in verification: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    y = x + maxDim;
+    yabs = y + maxDim;
+    z = yabs + maxDim;
+    zabs = z + maxDim;
+    for (r = 0; r < rounds; r++) {
+        verify_vector(x, ch->dims[ch->n], seed + r);
+        for (i = 0; i < ch->dims[ch->n]; i++) {
+            y[i] = x[i];
+            yabs[i] = fabs(x[i]);
+        }
+        for (t = factors - 1; t >= 0; t--) {  // y = A_t * y, yabs = |A_t| * yabs
+            const double *a = ch->factor[ch->power > 0 ? 0 : t];
+            int m = ch->power > 0 ? ch->dims[0] : ch->dims[t], n = ch->power > 0 ? ch->dims[0] : ch->dims[t + 1];
+            int low = chain_low(ch->part, ch->parts, m), mine = chain_rows(ch, m);
+#pragma omp parallel for private(k) schedule(static)
+            for (i = 0; i < mine; i++) {
+                double s = 0, sa = 0;
+                for (k = 0; k < n; k++) {
+                    s += a[(long) i * n + k] * y[k];
+                    sa += fabs(a[(long) i * n + k]) * yabs[k];
+                }
+                z[low + i] = s;
+                zabs[low + i] = sa;
+            }
+            if (ch->whole != NULL) {
+                ch->whole(z + low, m, 1, y);
+                ch->whole(zabs + low, m, 1, yabs);
+            } else {
+                memcpy(y, z, m * sizeof(double));
+                memcpy(yabs, zabs, m * sizeof(double));
+            }
+        }
+#pragma omp parallel for private(k) reduction(max:maxErr) schedule(static)
+        for (i = 0; i < rows; i++) {
+            const double *c = C + (long) i * ch->dims[ch->n];
+            double w = 0, e;
+            for (k = 0; k < ch->dims[ch->n]; k++)
+                w += c[k] * x[k];
+            e = fabs(y[row0 + i] - w);
+            e = yabs[row0 + i] > 0 ? e / yabs[row0 + i] : (e > 0 ? INFINITY : 0);
+            if (e != e) e = INFINITY;
+            if (e > maxErr) maxErr = e;
+        }
+    }
+    free(x);
+    return maxErr;
+}
+
+// Size passed to VERIFY_TOL for a chain: the rounding grows with the inner
+// dimensions of every product (and with k for a power)
+static int chain_tol_size(const chain_t *ch) {
+    long s = 0;
+    int t;
+
+    if (ch->power > 0) return (int) GEMM_MIN((long) ch->dims[0] * ch->power, INT_MAX);
+    for (t = 1; t <= ch->n; t++)
+        s += ch->dims[t];
+    return (int) GEMM_MIN(s, INT_MAX);
+}
+
+#endif // CHAIN_H
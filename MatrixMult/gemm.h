@@ -0,0 +1,401 @@
+//-- ----------------------------------------------------------------------------*/
+//  Cache-blocked multiplication kernel shared by MStandard, MOMP and MParallel
+//  Created 16.10.2026
+//
+//  C = A * B for square row-major 'size'x'size' matrices (the layout produced
+//  by allocate_real_matrix). The loops are tiled so that a KCxNC panel of B
+//  stays in L3, a MCxKC block of A in L2 and a KCxNR sliver of B in L1, and
+//  the innermost MRxNR tile of C is accumulated in registers.
+//  The micro kernel is picked once at startup from CPUID (AVX-512, AVX2+FMA or
+//  portable C), so a single binary runs at full speed on every grid host.
+//  Header only, so each driver still builds from a single source file.
+
+#ifndef GEMM_H
+#define GEMM_H
+
+#ifndef GEMM_MC
+#define GEMM_MC 96      // rows of A per L2 block
+#endif
+#ifndef GEMM_KC
+#define GEMM_KC 256     // depth of a block (shared dimension)
+#endif
+#ifndef GEMM_NC
+#define GEMM_NC 2048    // columns of B per L3 panel (multiple of every kernel NR)
+#endif
+
+#define GEMM_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// Block sizes in use: the defaults above, or the ones tuned for the host (tune.h)
+static int gemm_mc = GEMM_MC, gemm_kc = GEMM_KC, gemm_nc = GEMM_NC;
+
+#include "arena.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*gemm_kernel_fn)(int kc, const double *a, int lda,
+                               const double *b, int ldb, double *c, int ldc);
+
+// Micro kernel computing a full 'mr'x'nr' tile of C
+typedef struct {
+    const char *name;
+    int mr, nr;
+    gemm_kernel_fn fn;
+} gemm_kernel_t;
+
+//-- ----------------------------------------------------------------------------
+// Portable register-blocked micro kernel (4x8):
+// c[0..3][0..7] += a[.][0..kc-1] * b[0..kc-1][.]
+// 'lda', 'ldb' and 'ldc' are the row strides of the three operands.
+static void gemm_micro_scalar(int kc, const double *a, int lda,
+                              const double *b, int ldb, double *c, int ldc) {
+    double acc[4][8] = {{0}};
+    int p, r, s;
+
+    for (p = 0; p < kc; p++) {
+        const double *brow = b + (long) p * ldb;
+        for (r = 0; r < 4; r++) {
+            double av = a[(long) r * lda + p];
+            for (s = 0; s < 8; s++)
+                acc[r][s] += av * brow[s];
+        }
+    }
+    for (r = 0; r < 4; r++)
+        for (s = 0; s < 8; s++)
+            c[(long) r * ldc + s] += acc[r][s];
+}
+
+#ifdef GEMM_X86
+//-- ----------------------------------------------------------------------------
+// AVX2 + FMA micro kernel (6x8): 12 ymm accumulators, 2 loads of B and one
+// broadcast of A per row and step of k.
+#define GEMM_AVX2_ROW(r)                                               \
+    {                                                                  \
+        __m256d av = _mm256_broadcast_sd(a + (long) (r) * lda + p);    \
+        c##r##0 = _mm256_fmadd_pd(av, b0, c##r##0);                    \
+        c##r##1 = _mm256_fmadd_pd(av, b1, c##r##1);                    \
+    }
+#define GEMM_AVX2_STORE(r)                                                               \
+    {                                                                                    \
+        double *cr = c + (long) (r) * ldc;                                               \
+        _mm256_storeu_pd(cr, _mm256_add_pd(_mm256_loadu_pd(cr), c##r##0));              \
+        _mm256_storeu_pd(cr + 4, _mm256_add_pd(_mm256_loadu_pd(cr + 4), c##r##1));      \
+    }
+
+__attribute__((target("avx2,fma")))
+static void gemm_micro_avx2(int kc, const double *a, int lda,
+                            const double *b, int ldb, double *c, int ldc) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+    int p;
+
+    for (p = 0; p < kc; p++) {
+        const double *brow = b + (long) p * ldb;
+        __m256d b0 = _mm256_loadu_pd(brow);
+        __m256d b1 = _mm256_loadu_pd(brow + 4);
+        GEMM_AVX2_ROW(0) GEMM_AVX2_ROW(1) GEMM_AVX2_ROW(2)
+        GEMM_AVX2_ROW(3) GEMM_AVX2_ROW(4) GEMM_AVX2_ROW(5)
+    }
+    GEMM_AVX2_STORE(0) GEMM_AVX2_STORE(1) GEMM_AVX2_STORE(2)
+    GEMM_AVX2_STORE(3) GEMM_AVX2_STORE(4) GEMM_AVX2_STORE(5)
+}
+
+//-- ----------------------------------------------------------------------------
+// AVX-512 micro kernel (8x16): 16 zmm accumulators
+#define GEMM_AVX512_ROW(r)                                             \
+    {                                                                  \
+        __m512d av = _mm512_set1_pd(a[(long) (r) * lda + p]);          \
+        c##r##0 = _mm512_fmadd_pd(av, b0, c##r##0);                    \
+        c##r##1 = _mm512_fmadd_pd(av, b1, c##r##1);                    \
+    }
+#define GEMM_AVX512_STORE(r)                                                             \
+    {                                                                                    \
+        double *cr = c + (long) (r) * ldc;                                               \
+        _mm512_storeu_pd(cr, _mm512_add_pd(_mm512_loadu_pd(cr), c##r##0));              \
+        _mm512_storeu_pd(cr + 8, _mm512_add_pd(_mm512_loadu_pd(cr + 8), c##r##1));      \
+    }
+
+__attribute__((target("avx512f")))
+static void gemm_micro_avx512(int kc, const double *a, int lda,
+                              const double *b, int ldb, double *c, int ldc) {
+    __m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+    __m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+    __m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+    __m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+    __m512d c40 = _mm512_setzero_pd(), c41 = _mm512_setzero_pd();
+    __m512d c50 = _mm512_setzero_pd(), c51 = _mm512_setzero_pd();
+    __m512d c60 = _mm512_setzero_pd(), c61 = _mm512_setzero_pd();
+    __m512d c70 = _mm512_setzero_pd(), c71 = _mm512_setzero_pd();
+    int p;
+
+    for (p = 0; p < kc; p++) {
+        const double *brow = b + (long) p * ldb;
+        __m512d b0 = _mm512_loadu_pd(brow);
+        __m512d b1 = _mm512_loadu_pd(brow + 8);
+        GEMM_AVX512_ROW(0) GEMM_AVX512_ROW(1) GEMM_AVX512_ROW(2) GEMM_AVX512_ROW(3)
+        GEMM_AVX512_ROW(4) GEMM_AVX512_ROW(5) GEMM_AVX512_ROW(6) GEMM_AVX512_ROW(7)
+    }
+    GEMM_AVX512_STORE(0) GEMM_AVX512_STORE(1) GEMM_AVX512_STORE(2) GEMM_AVX512_STORE(3)
+    GEMM_AVX512_STORE(4) GEMM_AVX512_STORE(5) GEMM_AVX512_STORE(6) GEMM_AVX512_STORE(7)
+}
+#endif // GEMM_X86
+
+static gemm_kernel_t gemm_kernel = {"scalar", 4, 8, gemm_micro_scalar};
+static int gemm_kernel_ready = 0;
+
+//-- ----------------------------------------------------------------------------
+// Pick the widest micro kernel supported by this CPU. The environment
+// variable GEMM_KERNEL=scalar|avx2|avx512 restricts the choice (for testing).
+// Call once at startup, before any parallel region; the blocked kernel calls
+// it lazily otherwise.
+static const gemm_kernel_t *gemm_init(void) {
+    const char *force = getenv("GEMM_KERNEL");
+
+    if (gemm_kernel_ready) return &gemm_kernel;
+    gemm_kernel_ready = 1;
+#ifdef GEMM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && (force == NULL || strcmp(force, "avx512") == 0)) {
+        gemm_kernel = (gemm_kernel_t) {"avx512", 8, 16, gemm_micro_avx512};
+        return &gemm_kernel;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+        (force == NULL || strcmp(force, "scalar") != 0)) {
+        gemm_kernel = (gemm_kernel_t) {"avx2", 6, 8, gemm_micro_avx2};
+        return &gemm_kernel;
+    }
+#endif
+    (void) force;
+    return &gemm_kernel;
+}
+
+//-- ----------------------------------------------------------------------------
+// Plain loop for the partial tiles on the right/bottom borders
+static inline void gemm_edge_kernel(int mr, int nr, int kc, const double *a, int lda,
+                                    const double *b, int ldb, double *c, int ldc) {
+    int p, r, s;
+
+    for (r = 0; r < mr; r++)
+        for (p = 0; p < kc; p++) {
+            double av = a[(long) r * lda + p];
+            const double *brow = b + (long) p * ldb;
+            for (s = 0; s < nr; s++)
+                c[(long) r * ldc + s] += av * brow[s];
+        }
+}
+
+//-- ----------------------------------------------------------------------------
+// Packed B: the columns of B are cut into panels of NR (kernel tile width)
+// columns, each stored as 'size' contiguous rows of NR values, the last panel
+// zero padded. The kernels then stream B with unit stride.
+// Number of doubles needed for the packed copy of a 'size'x'size' B.
+static long gemm_packed_b_size(int size) {
+    int NR = gemm_init()->nr;
+    return (long) ((size + NR - 1) / NR) * NR * size;
+}
+
+//-- ----------------------------------------------------------------------------
+// Allocate (64 bytes aligned, see arena.h) the buffer receiving the packed copy of B
+static double *gemm_alloc_packed_b(int size) {
+    double *Bp = matrix_alloc(gemm_packed_b_size(size));
+
+    if (Bp == NULL) {
+        fprintf(stderr, "** Error in packed matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    return Bp;
+}
+
+//-- ----------------------------------------------------------------------------
+// Pack the 'panel'-th column panel of the 'k'x'n' block B (row stride 'ldb')
+// into Bp, which then holds panels of NR columns of height 'k'.
+static void gemm_pack_panel(int k, int n, const double *B, int ldb, double *Bp, int panel) {
+    int NR = gemm_init()->nr;
+    int j0 = panel * NR, nr = GEMM_MIN(NR, n - j0), p, s;
+    double *dst = Bp + (long) panel * NR * k;
+
+    for (p = 0; p < k; p++, dst += NR) {
+        const double *src = B + (long) p * ldb + j0;
+        for (s = 0; s < nr; s++) dst[s] = src[s];
+        for (; s < NR; s++) dst[s] = 0;
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// Pack the 'panel'-th column panel of the square B into Bp. Threads may pack
+// distinct panels concurrently (see gemm_pack_b_panels).
+static void gemm_pack_b_panel(int size, const double *B, double *Bp, int panel) {
+    gemm_pack_panel(size, size, B, size, Bp, panel);
+}
+
+// Number of column panels of the packed B
+static int gemm_pack_b_panels(int size) {
+    int NR = gemm_init()->nr;
+    return (size + NR - 1) / NR;
+}
+
+//-- ----------------------------------------------------------------------------
+// Pack the whole matrix B into Bp (sequentially)
+static inline void gemm_pack_b(int size, const double *B, double *Bp) {
+    int panel, panels = gemm_pack_b_panels(size);
+
+    for (panel = 0; panel < panels; panel++)
+        gemm_pack_b_panel(size, B, Bp, panel);
+}
+
+//-- ----------------------------------------------------------------------------
+// Blocked core: C[m x n] += A[m x k] * B[k x n], all row-major with row strides
+// 'lda', 'ldb' and 'ldc'. If 'Bp' is not NULL it holds B packed in panels of
+// NR columns of height 'k' (gemm_pack_b layout) and is read instead of 'B'.
+static void gemm_blocked(int m, int n, int k, const double *A, int lda,
+                         const double *B, int ldb, const double *Bp, double *C, int ldc) {
+    const gemm_kernel_t *kern = gemm_init();
+    int MR = kern->mr, NR = kern->nr;
+    int jc, pc, ic, jr, ir;
+
+    if (Bp != NULL) ldb = NR;
+    for (jc = 0; jc < n; jc += gemm_nc) {
+        int nc = GEMM_MIN(gemm_nc, n - jc);
+        for (pc = 0; pc < k; pc += gemm_kc) {
+            int kc = GEMM_MIN(gemm_kc, k - pc);
+            for (ic = 0; ic < m; ic += gemm_mc) {
+                int mc = GEMM_MIN(gemm_mc, m - ic);
+                for (jr = 0; jr < nc; jr += NR) {
+                    int nr = GEMM_MIN(NR, nc - jr);
+                    const double *b = Bp != NULL
+                                      ? Bp + (long) ((jc + jr) / NR) * NR * k + (long) pc * NR
+                                      : B + (long) pc * ldb + jc + jr;
+                    for (ir = 0; ir < mc; ir += MR) {
+                        int mr = GEMM_MIN(MR, mc - ir);
+                        const double *a = A + (long) (ic + ir) * lda + pc;
+                        double *c = C + (long) (ic + ir) * ldc + jc + jr;
+                        if (mr == MR && nr == NR)
+                            kern->fn(kc, a, lda, b, ldb, c, ldc);
+                        else
+                            gemm_edge_kernel(mr, nr, kc, a, lda, b, ldb, c, ldc);
+                    }
+                }
+            }
+        }
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// Compute the tile rows 'i0'..'i1'-1, columns 'j0'..'j1'-1 of C = A * B. The
+// tile of C is overwritten. If 'Bp' is not NULL it must hold B packed by
+// gemm_pack_b and 'j0' must be a multiple of the kernel tile width.
+static void gemm_tile(int size, const double *A, const double *B, const double *Bp,
+                      double *C, int i0, int i1, int j0, int j1) {
+    int i, NR = gemm_init()->nr;
+
+    for (i = i0; i < i1; i++)
+        memset(C + (long) i * size + j0, 0, (j1 - j0) * sizeof(double));
+    gemm_blocked(i1 - i0, j1 - j0, size, A + (long) i0 * size, size, B + j0, size,
+                 Bp != NULL ? Bp + (long) (j0 / NR) * NR * size : NULL, C + (long) i0 * size + j0, size);
+}
+
+//-- ----------------------------------------------------------------------------
+// Compute rows 'from'..'to'-1 of C = A * B. The rows of C are overwritten.
+// If 'Bp' is not NULL it must hold B packed by gemm_pack_b and is read
+// instead of 'B'. Callers split the row range between threads or ranks.
+static void gemm_block_rows_ex(int size, const double *A, const double *B, const double *Bp,
+                               double *C, int from, int to) {
+    gemm_tile(size, A, B, Bp, C, from, to, 0, size);
+}
+
+//-- ----------------------------------------------------------------------------
+// Reference triple loop (the original algorithm), rows 'from'..'to'-1 of C = A * B.
+// Only kept as the baseline of the benchmarks.
+static void gemm_naive_rows(int size, const double *A, const double *B, double *C, int from, int to) {
+    int i, j, k;
+
+    for (i = from; i < to; i++)
+        for (j = 0; j < size; j++) {
+            double sum = 0;
+            for (k = 0; k < size; k++)
+                sum += A[(long) i * size + k] * B[(long) k * size + j];
+            C[(long) i * size + j] = sum;
+        }
+}
+
+//-- ----------------------------------------------------------------------------
+// General matrix product, BLAS dgemm style, on row-major operands:
+//   C = alpha * op(A) * op(B) + beta * C
+// op(A) is MxK and op(B) KxN; op(X) = X, or its transpose if 'transX' is set
+// (A is then stored KxM, B NxK). 'lda', 'ldb', 'ldc' are the row strides, so
+// blocks of larger matrices are used in place. beta = 0 ignores the content
+// of C (NaN included). Each KCxNC block of op(B) is packed (scaled by alpha),
+// each MCxKC block of a transposed A copied row-major; the row blocks run in
+// parallel unless called from within a parallel region.
+static inline void gemm_ex(int transA, int transB, int M, int N, int K, double alpha,
+                           const double *A, int lda, const double *B, int ldb,
+                           double beta, double *C, int ldc) {
+    int NR = gemm_init()->nr;
+    int i, j, jc, pc, ic;
+
+    if (M <= 0 || N <= 0) return;
+    for (i = 0; i < M; i++) {
+        double *c = C + (long) i * ldc;
+        if (beta == 0)
+            memset(c, 0, N * sizeof(double));
+        else if (beta != 1)
+            for (j = 0; j < N; j++) c[j] *= beta;
+    }
+    if (alpha == 0 || K <= 0) return;
+
+    int ncMax = GEMM_MIN(gemm_nc, (N + NR - 1) / NR * NR);
+    double *Bp = matrix_alloc_heap((size_t) gemm_kc * ncMax);
+    if (Bp == NULL) {
+        fprintf(stderr, "** Error in gemm_ex: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    for (jc = 0; jc < N; jc += gemm_nc) {
+        int nc = GEMM_MIN(gemm_nc, N - jc);
+        for (pc = 0; pc < K; pc += gemm_kc) {
+            int kc = GEMM_MIN(gemm_kc, K - pc);
+
+            // alpha * op(B)[pc..pc+kc-1][jc..jc+nc-1] in panels of NR columns of height kc
+            for (j = 0; j < nc; j += NR) {
+                int nr = GEMM_MIN(NR, nc - j), p, s;
+                double *dst = Bp + (long) j * kc;
+                for (p = 0; p < kc; p++, dst += NR) {
+                    for (s = 0; s < nr; s++)
+                        dst[s] = alpha * (transB ? B[(long) (jc + j + s) * ldb + pc + p]
+                                                 : B[(long) (pc + p) * ldb + jc + j + s]);
+                    for (; s < NR; s++) dst[s] = 0;
+                }
+            }
+
+#pragma omp parallel for schedule(dynamic) if (M > gemm_mc)
+            for (ic = 0; ic < M; ic += gemm_mc) {
+                int mc = GEMM_MIN(gemm_mc, M - ic), r, p;
+                double *Ap = NULL;
+                if (transA) { // op(A) block copied row-major (A stored KxM)
+                    Ap = matrix_alloc_heap((size_t) mc * kc);
+                    if (Ap == NULL) {
+                        fprintf(stderr, "** Error in gemm_ex: insufficient memory **");
+                        fprintf(stderr, "** Program aborted................................ **");
+                        exit(1);
+                    }
+                    for (p = 0; p < kc; p++)
+                        for (r = 0; r < mc; r++)
+                            Ap[(long) r * kc + p] = A[(long) (pc + p) * lda + ic + r];
+                }
+                gemm_blocked(mc, nc, kc, transA ? Ap : A + (long) ic * lda + pc, transA ? kc : lda,
+                             NULL, 0, Bp, C + (long) ic * ldc + jc, ldc);
+                free(Ap);
+            }
+        }
+    }
+    free(Bp);
+}
+
+#endif // GEMM_H
@@ -0,0 +1,135 @@
+//-- ----------------------------------------------------------------------------*/
+//  Element types other than double for the blocked multiplication
+//  Created 16.10.2026
+//
+//  float, int32 and mixed (float operands, double accumulation and result)
+//  kernels are generated from gemmt_tmpl.h, one instantiation per type; the
+//  compiler vectorizes the register tile for the element width (16 floats
+//  per AVX-512 vector instead of 8 doubles). On x86 each micro kernel is
+//  cloned for AVX-512, AVX2 and baseline, and the loader picks the clone of
+//  the host, like gemm_init does for double. double itself stays on gemm.h.
+//  elem_* dispatch on the type chosen at run time (type= option).
+//  int32 products wrap around modulo 2^32 instead of overflowing.
+
+#ifndef GEMMT_H
+#define GEMMT_H
+
+#include <stdint.h>
+#include "gemm.h"
+
+#define GEMMT_MR 6      // rows of the register tile
+#define GEMMT_NR 16     // columns of the register tile (one AVX-512 vector of float/int32)
+
+#define GEMMT_CAT2(a, b) gemmt_##a##b
+#define GEMMT_CAT(a, b) GEMMT_CAT2(a, b)
+
+#if defined(GEMM_X86) && !defined(__clang__)
+#define GEMMT_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define GEMMT_CLONES
+#endif
+
+typedef enum { ELEM_F64, ELEM_F32, ELEM_I32, ELEM_MIXED } elem_t;
+
+static const char *elem_names[] = {"double", "float", "int32", "mixed"};
+
+#define GEMMT_NAME f32
+#define GEMMT_TIN float
+#define GEMMT_TACC float
+#define GEMMT_TOUT float
+#include "gemmt_tmpl.h"
+
+#define GEMMT_NAME i32
+#define GEMMT_TIN int32_t
+#define GEMMT_TACC uint32_t
+#define GEMMT_TOUT int32_t
+#include "gemmt_tmpl.h"
+
+#define GEMMT_NAME mixed     // float operands: filled and packed by the f32 functions
+#define GEMMT_TIN float
+#define GEMMT_TACC double
+#define GEMMT_TOUT double
+#define GEMMT_ROWS_ONLY
+#include "gemmt_tmpl.h"
+
+//-- ----------------------------------------------------------------------------
+// Element type named 'name' ("double", "float", "int32" or "mixed"), -1 if unknown
+static int elem_parse(const char *name) {
+    int t;
+
+    for (t = ELEM_F64; t <= ELEM_MIXED; t++)
+        if (strcmp(name, elem_names[t]) == 0) return t;
+    return -1;
+}
+
+// Bytes of an element of A and B, and of C
+static size_t elem_in_size(elem_t t) {
+    return t == ELEM_F64 ? sizeof(double) : t == ELEM_I32 ? sizeof(int32_t) : sizeof(float);
+}
+static size_t elem_out_size(elem_t t) {
+    return t == ELEM_F32 ? sizeof(float) : t == ELEM_I32 ? sizeof(int32_t) : sizeof(double);
+}
+
+// Element 'idx' of a result matrix, as a double (for display)
+static double elem_out_value(elem_t t, const void *C, long idx) {
+    if (t == ELEM_F32) return ((const float *) C)[idx];
+    if (t == ELEM_I32) return ((const int32_t *) C)[idx];
+    return ((const double *) C)[idx];
+}
+
+//-- ----------------------------------------------------------------------------
+// 'count' elements of 'bytes' each, 64 bytes aligned from the arena (NULL if exhausted)
+static void *elem_alloc(size_t count, size_t bytes) {
+    return matrix_alloc((count * bytes + sizeof(double) - 1) / sizeof(double));
+}
+
+// Fill the rows 'from'..'to'-1 of an operand with row + 1; 'M' points to row 'from'
+static void elem_fill(elem_t t, void *M, int size, int from, int to) {
+    if (t == ELEM_F64) {
+        double *m = (double *) M;
+        int i, j;
+#pragma omp parallel for private(j) schedule(static)
+        for (i = from; i < to; i++)
+            for (j = 0; j < size; j++) m[(long) (i - from) * size + j] = i + 1;
+    }
+    else if (t == ELEM_I32) gemmt_i32_fill(M, size, from, to);
+    else gemmt_f32_fill(M, size, from, to);  // float and mixed operands
+}
+
+//-- ----------------------------------------------------------------------------
+// Packed B: number of panels, elements of the whole packed copy, and packing of one panel
+static int elem_pack_panels(elem_t t, int size) {
+    int NR = t == ELEM_F64 ? gemm_init()->nr : GEMMT_NR;
+    return (size + NR - 1) / NR;
+}
+static size_t elem_packed_size(elem_t t, int size) {
+    return (size_t) elem_pack_panels(t, size) * (t == ELEM_F64 ? gemm_init()->nr : GEMMT_NR) * size;
+}
+static void elem_pack_panel(elem_t t, int size, const void *B, void *Bp, int panel) {
+    if (t == ELEM_F64) gemm_pack_b_panel(size, (const double *) B, (double *) Bp, panel);
+    else if (t == ELEM_I32) gemmt_i32_pack_panel(size, B, Bp, panel);
+    else gemmt_f32_pack_panel(size, B, Bp, panel);
+}
+
+//-- ----------------------------------------------------------------------------
+// Rows 'from'..'to'-1 of C = A * B with B packed; 'A' and 'C' point to row 'from'
+static void elem_rows(elem_t t, int size, const void *A, const void *Bp, void *C, int from, int to) {
+    switch (t) {
+    case ELEM_F64:
+        memset(C, 0, (size_t) (to - from) * size * sizeof(double));
+        gemm_blocked(to - from, size, size, (const double *) A, size, NULL, size, (const double *) Bp,
+                     (double *) C, size);
+        break;
+    case ELEM_F32:
+        gemmt_f32_rows(size, A, Bp, C, from, to);
+        break;
+    case ELEM_I32:
+        gemmt_i32_rows(size, A, Bp, C, from, to);
+        break;
+    case ELEM_MIXED:
+        gemmt_mixed_rows(size, A, Bp, C, from, to);
+        break;
+    }
+}
+
+#endif // GEMMT_H
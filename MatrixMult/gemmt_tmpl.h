@@ -0,0 +1,96 @@
+//-- ----------------------------------------------------------------------------*/
+//  Type-specialized blocked multiplication, instantiated by gemmt.h
+//  Created 16.10.2026
+//
+//  Included once per element type with GEMMT_NAME (function prefix), GEMMT_TIN
+//  (elements of A and B), GEMMT_TACC (accumulator) and GEMMT_TOUT (elements of
+//  C) defined; generates gemmt_<NAME>_fill, _pack_panel and _rows. With
+//  GEMMT_ROWS_ONLY only _rows is generated (the operands are filled and
+//  packed by the instantiation of the same GEMMT_TIN).
+//  No include guard on purpose.
+
+#define GEMMT_FN(fn) GEMMT_CAT(GEMMT_NAME, fn)
+
+//-- ----------------------------------------------------------------------------
+// Micro kernel: c[0..mr-1][0..nr-1] += a[.][0..kc-1] * b, b being a packed
+// sliver (kc rows of GEMMT_NR). Rows past 'mr' reuse the first row of A and
+// are dropped, so the loops keep their constant trip counts and vectorize.
+GEMMT_CLONES static void GEMMT_FN(_micro)(int kc, const GEMMT_TIN *a, int lda, int mr,
+                                          const GEMMT_TIN *b, GEMMT_TOUT *c, int ldc, int nr) {
+    GEMMT_TACC acc[GEMMT_MR][GEMMT_NR];
+    const GEMMT_TIN *ar[GEMMT_MR];
+    int i, j, p;
+
+    for (i = 0; i < GEMMT_MR; i++) {
+        ar[i] = a + (long) (i < mr ? i : 0) * lda;
+        for (j = 0; j < GEMMT_NR; j++) acc[i][j] = 0;
+    }
+    for (p = 0; p < kc; p++, b += GEMMT_NR)
+        for (i = 0; i < GEMMT_MR; i++) {
+            GEMMT_TACC ai = (GEMMT_TACC) ar[i][p];
+#pragma omp simd
+            for (j = 0; j < GEMMT_NR; j++)
+                acc[i][j] += ai * (GEMMT_TACC) b[j];
+        }
+    for (i = 0; i < mr; i++)
+        for (j = 0; j < nr; j++)
+            c[(long) i * ldc + j] = (GEMMT_TOUT) ((GEMMT_TACC) c[(long) i * ldc + j] + acc[i][j]);
+}
+
+#ifndef GEMMT_ROWS_ONLY
+//-- ----------------------------------------------------------------------------
+// Fill the rows 'from'..'to'-1 of a 'size'x'size' matrix with row + 1 (the
+// pattern allocate_real_matrix uses)
+static void GEMMT_FN(_fill)(void *M, int size, int from, int to) {
+    GEMMT_TIN *m = (GEMMT_TIN *) M;
+    int i, j;
+
+#pragma omp parallel for private(j) schedule(static)
+    for (i = from; i < to; i++)
+        for (j = 0; j < size; j++)
+            m[(long) (i - from) * size + j] = (GEMMT_TIN) (i + 1);
+}
+
+//-- ----------------------------------------------------------------------------
+// Pack the 'panel'-th panel of GEMMT_NR columns of the square B into Bp
+// (zero padded), like gemm_pack_b_panel
+static void GEMMT_FN(_pack_panel)(int size, const void *B, void *Bp, int panel) {
+    const GEMMT_TIN *src = (const GEMMT_TIN *) B + (long) panel * GEMMT_NR;
+    GEMMT_TIN *dst = (GEMMT_TIN *) Bp + (long) panel * GEMMT_NR * size;
+    int nr = GEMM_MIN(GEMMT_NR, size - panel * GEMMT_NR), p, s;
+
+    for (p = 0; p < size; p++, src += size, dst += GEMMT_NR) {
+        for (s = 0; s < nr; s++) dst[s] = src[s];
+        for (; s < GEMMT_NR; s++) dst[s] = 0;
+    }
+}
+#endif // GEMMT_ROWS_ONLY
+
+//-- ----------------------------------------------------------------------------
+// Rows 'from'..'to'-1 of C = A * B, with B packed by _pack_panel. 'A' and 'C'
+// point to row 'from'. C is overwritten.
+static void GEMMT_FN(_rows)(int size, const void *A, const void *Bp, void *C, int from, int to) {
+    const GEMMT_TIN *a = (const GEMMT_TIN *) A, *bp = (const GEMMT_TIN *) Bp;
+    GEMMT_TOUT *c = (GEMMT_TOUT *) C;
+    int m = to - from, pc, ic, jr, ir;
+
+    memset(c, 0, (size_t) m * size * sizeof(GEMMT_TOUT));
+    for (pc = 0; pc < size; pc += gemm_kc) {
+        int kc = GEMM_MIN(gemm_kc, size - pc);
+        for (ic = 0; ic < m; ic += gemm_mc) {
+            int mc = GEMM_MIN(gemm_mc, m - ic);
+            for (jr = 0; jr < size; jr += GEMMT_NR)
+                for (ir = 0; ir < mc; ir += GEMMT_MR)
+                    GEMMT_FN(_micro)(kc, a + (long) (ic + ir) * size + pc, size, GEMM_MIN(GEMMT_MR, mc - ir),
+                                     bp + (long) jr * size + (long) pc * GEMMT_NR,
+                                     c + (long) (ic + ir) * size + jr, size, GEMM_MIN(GEMMT_NR, size - jr));
+        }
+    }
+}
+
+#undef GEMMT_FN
+#undef GEMMT_NAME
+#undef GEMMT_TIN
+#undef GEMMT_TACC
+#undef GEMMT_TOUT
+#undef GEMMT_ROWS_ONLY
@@ -0,0 +1,169 @@
+//-- ----------------------------------------------------------------------------*/
+//  Binary matrix files, read and written through mmap
+//  Created 16.10.2026
+//
+//  File format (all integers little endian, as written by x86 hosts):
+//    offset  size  field
+//         0     8  magic        "MATRIX\0\1"
+//         8     4  version      1
+//        12     4  dtype        1 = float64 (MATIO_F64)
+//        16     4  layout       0 = row-major (MATIO_ROW_MAJOR)
+//        20     4  reserved     0
+//        24     8  rows
+//        32     8  cols
+//        40     8  data_offset  64 (start of the elements, 64 bytes aligned)
+//        48    16  padding      0
+//        64     -  rows*cols elements, row after row
+//  The data offset keeps a mapped matrix 64 bytes aligned, so the kernels can
+//  read the operands straight from the page cache.
+
+#ifndef MATIO_H
+#define MATIO_H
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MATIO_MAGIC "MATRIX\0\1"
+#define MATIO_VERSION 1
+#define MATIO_F64 1
+#define MATIO_ROW_MAJOR 0
+#define MATIO_DATA_OFFSET 64
+
+typedef struct {
+    char magic[8];
+    uint32_t version, dtype, layout, reserved;
+    uint64_t rows, cols, data_offset;
+    char padding[16];
+} matio_header_t;
+
+//-- ----------------------------------------------------------------------------
+// Fill a header for a 'rows'x'cols' float64 row-major matrix
+static void matio_make_header(matio_header_t *hdr, long rows, long cols) {
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, MATIO_MAGIC, 8);
+    hdr->version = MATIO_VERSION;
+    hdr->dtype = MATIO_F64;
+    hdr->layout = MATIO_ROW_MAJOR;
+    hdr->rows = rows;
+    hdr->cols = cols;
+    hdr->data_offset = MATIO_DATA_OFFSET;
+}
+
+//-- ----------------------------------------------------------------------------
+// Check a header read from 'path'; returns 0 if it is a float64 row-major matrix
+static int matio_check_header(const matio_header_t *hdr, const char *path) {
+    if (memcmp(hdr->magic, MATIO_MAGIC, 8) != 0 || hdr->version != MATIO_VERSION) {
+        fprintf(stderr, "** %s is not a matrix file **\n", path);
+        return -1;
+    }
+    if (hdr->dtype != MATIO_F64 || hdr->layout != MATIO_ROW_MAJOR) {
+        fprintf(stderr, "** %s: unsupported element type or layout (%u, %u) **\n", path, hdr->dtype, hdr->layout);
+        return -1;
+    }
+    return 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Read and check the header of 'path'; returns 0 on success
+static int matio_read_header(const char *path, matio_header_t *hdr) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || read(fd, hdr, sizeof(*hdr)) != sizeof(*hdr)) {
+        fprintf(stderr, "** Cannot read matrix file %s **\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    close(fd);
+    return matio_check_header(hdr, path);
+}
+
+// A mapped matrix file
+typedef struct {
+    void *base;
+    size_t length;
+    int writable;
+} matio_map_t;
+
+//-- ----------------------------------------------------------------------------
+// Check that 'path' holds a square matrix. If '*size' is 0 it is set from the
+// file, otherwise the file must be '*size'x'*size'. Returns 0 on success.
+static inline int matio_square_size(const char *path, int *size) {
+    matio_header_t hdr;
+
+    if (matio_read_header(path, &hdr) != 0) return -1;
+    if (hdr.rows != hdr.cols || (*size > 0 && hdr.rows != (uint64_t) *size)) {
+        fprintf(stderr, "** %s is %lux%lu, expected a square %dx%d matrix **\n", path,
+                (unsigned long) hdr.rows, (unsigned long) hdr.cols, *size, *size);
+        return -1;
+    }
+    *size = (int) hdr.rows;
+    return 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Map the matrix of 'path' read-only and return a pointer to its elements
+// (NULL on error). The header is returned in 'hdr'. The pages are read in
+// while mapping (MAP_POPULATE) so the I/O is not charged to the multiply;
+// release with matio_unmap.
+static inline double *matio_map_read(const char *path, matio_header_t *hdr, matio_map_t *map) {
+    struct stat st;
+    int fd;
+
+    if (matio_read_header(path, hdr) != 0) return NULL;
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 ||
+        (size_t) st.st_size < hdr->data_offset + hdr->rows * hdr->cols * sizeof(double)) {
+        fprintf(stderr, "** Matrix file %s is truncated **\n", path);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    map->length = hdr->data_offset + hdr->rows * hdr->cols * sizeof(double);
+    map->writable = 0;
+    map->base = mmap(NULL, map->length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map->base == MAP_FAILED) {
+        fprintf(stderr, "** Cannot map matrix file %s **\n", path);
+        return NULL;
+    }
+    return (double *) ((char *) map->base + hdr->data_offset);
+}
+
+//-- ----------------------------------------------------------------------------
+// Create (or truncate) 'path' for a 'rows'x'cols' matrix, write its header and
+// map it writable. The result can be computed directly into the returned
+// elements (zero copy); matio_unmap flushes them to the file.
+static inline double *matio_map_create(const char *path, long rows, long cols, matio_map_t *map) {
+    matio_header_t hdr;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    matio_make_header(&hdr, rows, cols);
+    map->length = MATIO_DATA_OFFSET + rows * cols * sizeof(double);
+    map->writable = 1;
+    if (fd < 0 || ftruncate(fd, map->length) != 0) {
+        fprintf(stderr, "** Cannot create matrix file %s **\n", path);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    map->base = mmap(NULL, map->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map->base == MAP_FAILED) {
+        fprintf(stderr, "** Cannot map matrix file %s **\n", path);
+        return NULL;
+    }
+    memcpy(map->base, &hdr, sizeof(hdr));
+    return (double *) ((char *) map->base + MATIO_DATA_OFFSET);
+}
+
+//-- ----------------------------------------------------------------------------
+// Release a mapping, writing the pages of a created file back first
+static inline void matio_unmap(matio_map_t *map) {
+    if (map->base == NULL) return;
+    if (map->writable) msync(map->base, map->length, MS_SYNC);
+    munmap(map->base, map->length);
+    map->base = NULL;
+}
+
+#endif // MATIO_H
@@ -0,0 +1,257 @@
+//-- ----------------------------------------------------------------------------*/
+//  Out-of-core multiplication of matrix files (see matio.h)
+//  Created 16.10.2026
+//
+//  C = A * B when the matrices do not fit in memory. C is cut into TxT tiles;
+//  for each tile the matching TxKB tiles of A and KBxT tiles of B are read from
+//  the files and accumulated into the tile of C, which is then written back.
+//  The reads are double buffered: a helper thread loads the next pair of tiles
+//  while the OpenMP threads multiply the current one. T and KB are derived
+//  from the memory budget, so the peak memory does not depend on the size.
+
+#ifndef OOC_H
+#define OOC_H
+
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include <omp.h>
+#include "gemm.h"
+#include "matio.h"
+
+#define OOC_DEFAULT_MEM 1024    // default memory budget in MB
+#define OOC_ALIGN 16            // tile sizes are multiples of this (a multiple of every kernel NR)
+
+// Statistics of one out-of-core multiplication
+typedef struct {
+    int tile, depth;            // T and KB
+    double readBytes, writeBytes;
+    double waitTime;            // time the computation waited for its operands
+    double writeTime;           // time spent writing the tiles of C
+} ooc_stats_t;
+
+// One pending load: a tile of A and a tile of B
+typedef struct {
+    int fdA, fdB, size;
+    long offA, offB;            // data offsets of the files
+    int i0, i1, j0, j1, k0, k1;
+    double *A, *B;              // (i1-i0)x(k1-k0) and (k1-k0)x(j1-j0), row-major
+    int err;
+} ooc_load_t;
+
+//-- ----------------------------------------------------------------------------
+// Read 'count' bytes at 'offset' of 'fd' (pread may return less). Returns 0 on success.
+static int ooc_pread(int fd, void *buf, size_t count, off_t offset) {
+    char *p = (char *) buf;
+
+    while (count > 0) {
+        ssize_t n = pread(fd, p, count, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        count -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Write 'count' bytes at 'offset' of 'fd'. Returns 0 on success.
+static int ooc_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    const char *p = (const char *) buf;
+
+    while (count > 0) {
+        ssize_t n = pwrite(fd, p, count, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        count -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Read the rows 'r0'..'r1'-1, columns 'c0'..'c1'-1 of the 'size'x'size' matrix
+// of 'fd' into 'tile' (one read per row, whole rows in one read)
+static int ooc_read_tile(int fd, long off, int size, int r0, int r1, int c0, int c1, double *tile) {
+    int r, w = c1 - c0;
+
+    if (c0 == 0 && c1 == size)
+        return ooc_pread(fd, tile, (size_t) (r1 - r0) * size * sizeof(double),
+                         off + (off_t) r0 * size * sizeof(double));
+    for (r = r0; r < r1; r++)
+        if (ooc_pread(fd, tile + (long) (r - r0) * w, w * sizeof(double),
+                      off + ((off_t) r * size + c0) * sizeof(double)) != 0)
+            return -1;
+    return 0;
+}
+
+// Body of the loader thread
+static void *ooc_load(void *arg) {
+    ooc_load_t *l = (ooc_load_t *) arg;
+
+    l->err = ooc_read_tile(l->fdA, l->offA, l->size, l->i0, l->i1, l->k0, l->k1, l->A) != 0 ||
+             ooc_read_tile(l->fdB, l->offB, l->size, l->k0, l->k1, l->j0, l->j1, l->B) != 0;
+    return NULL;
+}
+
+//-- ----------------------------------------------------------------------------
+// Tile sizes fitting 'memBytes': the tile of C (T*T), two buffers for the
+// tiles of A and B (2 * 2*T*KB) and the packed tile of B (T*KB) take
+// T*T + 5*T*KB doubles; KB = T/2 as long as the budget allows.
+static void ooc_tile_sizes(int size, size_t memBytes, int *tile, int *depth) {
+    double doubles = memBytes / sizeof(double);
+    int t = (int) sqrt(doubles / 3.5) / OOC_ALIGN * OOC_ALIGN, kb;
+
+    if (t < OOC_ALIGN) t = OOC_ALIGN;
+    if (t >= size) t = (size + OOC_ALIGN - 1) / OOC_ALIGN * OOC_ALIGN;
+    kb = (int) ((doubles - (double) t * t) / (5.0 * t)) / OOC_ALIGN * OOC_ALIGN;
+    if (kb < OOC_ALIGN) kb = OOC_ALIGN;
+    if (kb > size) kb = size;
+    *tile = t;
+    *depth = kb;
+}
+
+//-- ----------------------------------------------------------------------------
+// Create the file of the 'size'x'size' result C (header, then a hole for the
+// elements). Returns 0 on success.
+static int ooc_create(const char *path, int size) {
+    matio_header_t hdr;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    matio_make_header(&hdr, size, size);
+    if (fd < 0 || ooc_pwrite(fd, &hdr, sizeof(hdr), 0) != 0 ||
+        ftruncate(fd, MATIO_DATA_OFFSET + (off_t) size * size * sizeof(double)) != 0) {
+        fprintf(stderr, "** Cannot create matrix file %s **\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Compute the rows 'row0'..'row1'-1 of C = A * B for the square matrices of the
+// files 'fileA' and 'fileB', and write them to 'fileC', which must already
+// exist (ooc_create). At most about 'memBytes' bytes are allocated. Distinct
+// processes may compute distinct row ranges of the same file concurrently.
+// Returns 0 on success; 'st' (if not NULL) receives the statistics.
+static int ooc_multiply(const char *fileA, const char *fileB, const char *fileC, int size,
+                        int row0, int row1, size_t memBytes, int debug, ooc_stats_t *st) {
+    matio_header_t hA, hB;
+    ooc_load_t load[2];
+    pthread_t loader;
+    ooc_stats_t s = {0};
+    int T, KB, fdA, fdB, fdC, cur = 0, err = 0, i, nsteps = 0, step;
+    int nk, nj, nomem = 0;
+    double t;
+
+    if (matio_read_header(fileA, &hA) != 0 || matio_read_header(fileB, &hB) != 0) return -1;
+    ooc_tile_sizes(size, memBytes, &T, &KB);
+    s.tile = T;
+    s.depth = KB;
+    if (debug) fprintf(stderr, "Out-of-core tiles: C %dx%d, depth %d (budget %lu MB)\n", T, T, KB,
+                       (unsigned long) (memBytes >> 20));
+
+    fdA = open(fileA, O_RDONLY);
+    fdB = open(fileB, O_RDONLY);
+    fdC = open(fileC, O_WRONLY);
+    double *Ct = matrix_alloc_heap((size_t) T * T);
+    double *Bp = matrix_alloc_heap((size_t) KB * T);
+    for (i = 0; i < 2; i++) {
+        load[i].A = matrix_alloc_heap((size_t) T * KB);
+        load[i].B = matrix_alloc_heap((size_t) KB * T);
+        nomem |= load[i].A == NULL || load[i].B == NULL;
+    }
+    if (fdA < 0 || fdB < 0 || fdC < 0) {
+        fprintf(stderr, "** Error in out-of-core multiply: cannot open the matrix files **\n");
+        err = 1;
+    }
+    else if (nomem || Ct == NULL || Bp == NULL) {
+        fprintf(stderr, "** Error in out-of-core multiply: insufficient memory for the tiles **\n");
+        err = 1;
+    }
+
+    // The steps (tile of C, depth) are numbered so the loader can run one step ahead
+    nk = (size + KB - 1) / KB;
+    nj = (size + T - 1) / T;
+    if (!err) nsteps = ((row1 - row0 + T - 1) / T) * nj * nk;
+
+#define OOC_STEP(l, stp) do {                                                   \
+        int ci = (stp) / nk / nj, cj = (stp) / nk % nj, ck = (stp) % nk;        \
+        (l)->fdA = fdA; (l)->fdB = fdB; (l)->size = size;                       \
+        (l)->offA = hA.data_offset; (l)->offB = hB.data_offset;                 \
+        (l)->i0 = row0 + ci * T; (l)->i1 = GEMM_MIN((l)->i0 + T, row1);         \
+        (l)->j0 = cj * T; (l)->j1 = GEMM_MIN((l)->j0 + T, size);                \
+        (l)->k0 = ck * KB; (l)->k1 = GEMM_MIN((l)->k0 + KB, size);              \
+    } while (0)
+
+    if (nsteps > 0) {  // the first load is not overlapped
+        t = omp_get_wtime();
+        OOC_STEP(&load[0], 0);
+        ooc_load(&load[0]);
+        s.waitTime += omp_get_wtime() - t;
+    }
+    for (step = 0; step < nsteps && !err; step++) {
+        ooc_load_t *l = &load[cur];
+        int m = l->i1 - l->i0, n = l->j1 - l->j0, kc = l->k1 - l->k0, started = 0;
+
+        if (l->err) {
+            err = 1;
+            break;
+        }
+        s.readBytes += ((double) m * kc + (double) kc * n) * sizeof(double);
+
+        // Start loading the next step into the other buffers
+        if (step + 1 < nsteps) {
+            OOC_STEP(&load[1 - cur], step + 1);
+            started = pthread_create(&loader, NULL, ooc_load, &load[1 - cur]) == 0;
+            if (!started) ooc_load(&load[1 - cur]);
+        }
+
+        // Accumulate into the tile of C (row stride n)
+        if (l->k0 == 0) memset(Ct, 0, (size_t) m * n * sizeof(double));
+#pragma omp parallel for schedule(static)
+        for (i = 0; i < (n + gemm_init()->nr - 1) / gemm_init()->nr; i++)
+            gemm_pack_panel(kc, n, l->B, n, Bp, i);
+#pragma omp parallel for schedule(dynamic)
+        for (i = 0; i < m; i += gemm_mc)
+            gemm_blocked(GEMM_MIN(gemm_mc, m - i), n, kc, l->A + (long) i * kc, kc, l->B, n, Bp,
+                         Ct + (long) i * n, n);
+
+        // Last depth of the tile: write it back
+        if (l->k1 == size) {
+            int r;
+            t = omp_get_wtime();
+            for (r = 0; r < m && !err; r++)
+                err = ooc_pwrite(fdC, Ct + (long) r * n, n * sizeof(double),
+                                 MATIO_DATA_OFFSET + ((off_t) (l->i0 + r) * size + l->j0) * sizeof(double)) != 0;
+            s.writeTime += omp_get_wtime() - t;
+            s.writeBytes += (double) m * n * sizeof(double);
+        }
+
+        t = omp_get_wtime();
+        if (started) pthread_join(loader, NULL);
+        s.waitTime += omp_get_wtime() - t;
+        cur = 1 - cur;
+    }
+#undef OOC_STEP
+
+    if (nsteps > 0 && (err || fsync(fdC) != 0)) {
+        fprintf(stderr, "** Error in out-of-core multiply: I/O error on the matrix files **\n");
+        err = 1;
+    }
+    if (fdA >= 0) close(fdA);
+    if (fdB >= 0) close(fdB);
+    if (fdC >= 0) close(fdC);
+    free(Ct);
+    free(Bp);
+    for (i = 0; i < 2; i++) {
+        free(load[i].A);
+        free(load[i].B);
+    }
+    if (st != NULL) *st = s;
+    return err ? -1 : 0;
+}
+
+#endif // OOC_H
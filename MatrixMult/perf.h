@@ -0,0 +1,124 @@
+//-- ----------------------------------------------------------------------------*/
+//  Hardware performance counters per phase (Linux perf_event_open)
+//  Created 16.10.2026
+//
+//  Every OpenMP thread opens its own counters (cycles, instructions, L1 data
+//  read misses, last level cache misses; user space only, which is allowed
+//  with the default perf_event_paranoid = 2). The master thread reads and sums
+//  them at the start and end of each phase. The memory bandwidth is estimated
+//  from the LLC misses (64 bytes each, lines fetched from memory: a lower
+//  bound, as write-backs and prefetches are not counted). Where the counters
+//  are not available (containers, VMs without PMU) the phases report their
+//  time only and the counters read -1.
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <omp.h>
+
+#define PERF_MAX_THREADS 512
+
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1_MISSES, PERF_LLC_MISSES, PERF_NCOUNTERS };
+
+static const char *perf_counter_names[PERF_NCOUNTERS] = {"cycles", "instructions", "L1misses", "LLCmisses"};
+
+static int perf_fd[PERF_MAX_THREADS][PERF_NCOUNTERS];
+static int perf_nthreads = 0;       // 0: counters not opened
+static int perf_available = 0;      // at least one counter could be opened
+
+// One measured phase
+typedef struct {
+    const char *name;
+    double time, start;
+    double count[PERF_NCOUNTERS], base[PERF_NCOUNTERS];
+} perf_phase_t;
+
+//-- ----------------------------------------------------------------------------
+// Open the counters of the calling thread
+static void perf_open_thread(int t) {
+    static const uint64_t config[PERF_NCOUNTERS][2] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    };
+    struct perf_event_attr attr;
+    int c;
+
+    for (c = 0; c < PERF_NCOUNTERS; c++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = (uint32_t) config[c][0];
+        attr.config = config[c][1];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perf_fd[t][c] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// Open the counters of every thread of the OpenMP team. Call outside of any
+// parallel region, once the number of threads is set.
+static void perf_open(void) {
+    int t, c;
+
+#pragma omp parallel
+    {
+        int me = omp_get_thread_num();
+        if (me < PERF_MAX_THREADS) perf_open_thread(me);
+#pragma omp single
+        perf_nthreads = GEMM_MIN(omp_get_num_threads(), PERF_MAX_THREADS);
+    }
+    for (t = 0; t < perf_nthreads; t++)
+        for (c = 0; c < PERF_NCOUNTERS; c++)
+            if (perf_fd[t][c] >= 0) perf_available = 1;
+}
+
+// Sum of each counter over the threads (-1 if it could not be opened)
+static void perf_read(double value[PERF_NCOUNTERS]) {
+    int t, c;
+    uint64_t v;
+
+    for (c = 0; c < PERF_NCOUNTERS; c++) {
+        value[c] = perf_nthreads > 0 && perf_fd[0][c] >= 0 ? 0 : -1;
+        for (t = 0; t < perf_nthreads; t++)
+            if (perf_fd[t][c] >= 0 && read(perf_fd[t][c], &v, sizeof(v)) == sizeof(v) && value[c] >= 0)
+                value[c] += (double) v;
+    }
+}
+
+static void perf_close(void) {
+    int t, c;
+
+    for (t = 0; t < perf_nthreads; t++)
+        for (c = 0; c < PERF_NCOUNTERS; c++)
+            if (perf_fd[t][c] >= 0) close(perf_fd[t][c]);
+    perf_nthreads = 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Start and end a phase; a phase may be entered several times (accumulated).
+// Without perf_open only the time is measured.
+static void perf_phase_begin(perf_phase_t *ph) {
+    if (perf_nthreads > 0) perf_read(ph->base);
+    ph->start = omp_get_wtime();
+}
+
+static void perf_phase_end(perf_phase_t *ph) {
+    double now[PERF_NCOUNTERS];
+    int c;
+
+    ph->time += omp_get_wtime() - ph->start;
+    if (perf_nthreads == 0) return;
+    perf_read(now);
+    for (c = 0; c < PERF_NCOUNTERS; c++)
+        ph->count[c] = now[c] < 0 ? -1 : ph->count[c] + now[c] - ph->base[c];
+}
+
+#endif // PERF_H
@@ -1,12 +1,12 @@
 #!/bin/bash
-for run in {1..3..1}
+# Size sweep of the row stripe mode on the grid: 1 warm-up and 3 timed runs per
+# size inside one launch (median, stddev, GFLOP/s and % of peak), one CSV
+# record per size appended to parallel.csv.
+HOSTS=grid10,grid11,grid12,grid13,grid14,grid15,grid16,grid17,grid18,grid19
+# Tune every host first (one MOMP per host), the cached configuration is
+# loaded by every rank of the sweep
+mpirun -host $HOSTS ./MOMP tune
+for i in {600..9800..400}
 do
-	echo 'New run'
-	echo $run
-	echo 'New run' >> parallel.log
-	echo $run >> parallel.log
-	for i in {600..9800..400}
-	do
-		mpirun -host grid10,grid11,grid12,grid13,grid14,grid15,grid16,grid17,grid18,grid19 ./MParallel $i >> parallel.log
-	done
+	mpirun -host $HOSTS ./MParallel $i bench=3 warmup=1 csv=parallel.csv
 done
@@ -0,0 +1,206 @@
+//-- ----------------------------------------------------------------------------*/
+//  Sparse (CSR) times dense multiplication (sparse option)
+//  Created 16.10.2026
+//
+//  C = A * B with A in compressed sparse rows: each row of C accumulates the
+//  rows of B picked by the nonzeros of the row of A (scaled), in column
+//  blocks of SPARSE_NB so the row of C stays in L1/L2 while it is updated.
+//  This costs 2 * nnz * n flops instead of 2 * n^3. The rows are split
+//  between threads (and ranks, see MParallel) so every part holds about the
+//  same number of nonzeros, as the cost of a row is its nonzero count.
+//
+//  The density of a dense A is estimated on sampled rows when it is loaded;
+//  the sparse kernel moves a row of B per nonzero and runs at a fraction of
+//  the speed of the blocked dense kernel, so it only pays off below a density
+//  of about that fraction: SPARSE_DENSITY (see sparse_threshold). Measured
+//  with the AVX-512 kernel, sizes 2000 and 4000, the two break even at a
+//  density of 0.07-0.08.
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <stdint.h>
+#include <omp.h>
+
+#define SPARSE_NB 2048              // columns of B and C per block
+#define SPARSE_DENSITY 0.06         // default density below which the sparse kernel is faster
+#define SPARSE_SAMPLE_ROWS 64       // rows read to estimate the density
+
+// Compressed sparse rows: the nonzeros of row i are val[rowptr[i]..rowptr[i+1]-1],
+// in the columns col[..]
+typedef struct {
+    int rows, cols;
+    long nnz;
+    long *rowptr;
+    int *col;
+    double *val;
+} csr_t;
+
+//-- ----------------------------------------------------------------------------
+// Density below which the sparse kernel is used: $SPARSE_DENSITY or the default
+static double sparse_threshold(void) {
+    const char *env = getenv("SPARSE_DENSITY");
+
+    return env != NULL ? atof(env) : SPARSE_DENSITY;
+}
+
+// Fraction of nonzeros of the 'rows'x'n' row-major M, counted on (at most)
+// SPARSE_SAMPLE_ROWS rows spread over the matrix
+static double sparse_sample_density(int rows, int n, const double *M) {
+    int samples = GEMM_MIN(rows, SPARSE_SAMPLE_ROWS), s, j;
+    long nz = 0;
+
+    if (samples <= 0 || n <= 0) return 0;
+#pragma omp parallel for private(j) reduction(+:nz) schedule(static)
+    for (s = 0; s < samples; s++) {
+        const double *m = M + (long) ((long) s * rows / samples) * n;
+        for (j = 0; j < n; j++)
+            nz += m[j] != 0;
+    }
+    return (double) nz / ((double) samples * n);
+}
+
+//-- ----------------------------------------------------------------------------
+// Whether element (i, j) of a generated matrix of the given density is kept:
+// a hash of the position, so every rank generates the same pattern
+static int sparse_keep(long i, long j, double density) {
+    uint64_t z = (uint64_t) i * 0x9E3779B97F4A7C15ULL + (uint64_t) j * 0xC2B2AE3D27D4EB4FULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (double) ((z ^ (z >> 31)) >> 11) < density * 9007199254740992.0;  // 2^53
+}
+
+// Zero the elements of the 'rows'x'n' M (its first row is row 'row0' of the
+// matrix) that a matrix of the given density does not keep
+static void sparse_thin(double *M, int rows, int n, int row0, double density) {
+    int i, j;
+
+    if (density >= 1) return;
+#pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < rows; i++)
+        for (j = 0; j < n; j++)
+            if (!sparse_keep(row0 + i, j, density)) M[(long) i * n + j] = 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Allocate a CSR matrix of 'rows'x'cols' with room for 'nnz' nonzeros
+static void csr_alloc(csr_t *a, int rows, int cols, long nnz) {
+    a->rows = rows;
+    a->cols = cols;
+    a->nnz = nnz;
+    a->rowptr = (long *) malloc((rows + 1) * sizeof(long));
+    a->col = (int *) malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    a->val = (double *) malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+    if (a->rowptr == NULL || a->col == NULL || a->val == NULL) {
+        fprintf(stderr, "** Error in sparse matrix creation: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+}
+
+static void csr_free(csr_t *a) {
+    free(a->rowptr);
+    free(a->col);
+    free(a->val);
+}
+
+// Row pointers from the nonzero counts of the rows (count[i] for row i)
+static long csr_rowptr(long *rowptr, const long *count, int rows) {
+    int i;
+
+    rowptr[0] = 0;
+    for (i = 0; i < rows; i++)
+        rowptr[i + 1] = rowptr[i] + count[i];
+    return rowptr[rows];
+}
+
+//-- ----------------------------------------------------------------------------
+// CSR copy of the 'rows'x'n' row-major M (two parallel passes: count, fill)
+static void csr_from_dense(csr_t *a, int rows, int n, const double *M) {
+    long *count = (long *) malloc((rows > 0 ? rows : 1) * sizeof(long)), nnz = 0;
+    int i, j;
+
+#pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < rows; i++) {
+        long c = 0;
+        for (j = 0; j < n; j++)
+            c += M[(long) i * n + j] != 0;
+        count[i] = c;
+    }
+    for (i = 0; i < rows; i++)
+        nnz += count[i];
+    csr_alloc(a, rows, n, nnz);
+    csr_rowptr(a->rowptr, count, rows);
+#pragma omp parallel for private(j) schedule(static)
+    for (i = 0; i < rows; i++) {
+        long p = a->rowptr[i];
+        for (j = 0; j < n; j++)
+            if (M[(long) i * n + j] != 0) {
+                a->col[p] = j;
+                a->val[p++] = M[(long) i * n + j];
+            }
+    }
+    free(count);
+}
+
+//-- ----------------------------------------------------------------------------
+// Split the rows of 'rowptr' ('rows' rows) into 'parts' ranges of about the
+// same number of nonzeros: part t gets rows bounds[t]..bounds[t+1]-1
+static void csr_partition(const long *rowptr, int rows, int parts, int *bounds) {
+    long nnz = rowptr[rows];
+    int t;
+
+    bounds[0] = 0;
+    for (t = 1; t < parts; t++) {
+        long target = (long) ((double) nnz * t / parts);
+        int lo = bounds[t - 1], hi = rows;
+        while (lo < hi) {   // first row starting at or after the target
+            int mid = lo + (hi - lo) / 2;
+            if (rowptr[mid] < target) lo = mid + 1;
+            else hi = mid;
+        }
+        bounds[t] = lo;
+    }
+    bounds[parts] = rows;
+}
+
+//-- ----------------------------------------------------------------------------
+// Rows 'r0'..'r1'-1 of C = A * B (C overwritten, row stride 'n' = columns of B)
+static void csr_multiply_rows(const csr_t *a, const double *B, int n, double *C, int r0, int r1) {
+    int i, jc, j;
+    long p;
+
+    for (i = r0; i < r1; i++)
+        memset(C + (long) i * n, 0, n * sizeof(double));
+    for (jc = 0; jc < n; jc += SPARSE_NB) {
+        int nb = GEMM_MIN(SPARSE_NB, n - jc);
+        for (i = r0; i < r1; i++) {
+            double *c = C + (long) i * n + jc;
+            for (p = a->rowptr[i]; p < a->rowptr[i + 1]; p++) {
+                const double *b = B + (long) a->col[p] * n + jc;
+                double v = a->val[p];
+#pragma omp simd
+                for (j = 0; j < nb; j++)
+                    c[j] += v * b[j];
+            }
+        }
+    }
+}
+
+// C = A * B with the threads on ranges of rows of the same nonzero count
+static void csr_multiply(const csr_t *a, const double *B, int n, double *C) {
+    int nthreads = omp_get_max_threads();
+    int *bounds = (int *) malloc((nthreads + 1) * sizeof(int));
+
+    csr_partition(a->rowptr, a->rows, nthreads, bounds);
+#pragma omp parallel
+    {
+        int t;
+        for (t = omp_get_thread_num(); t < nthreads; t += omp_get_num_threads())
+            csr_multiply_rows(a, B, n, C, bounds[t], bounds[t + 1]);
+    }
+    free(bounds);
+}
+
+#endif // SPARSE_H
@@ -0,0 +1,181 @@
+//-- ----------------------------------------------------------------------------*/
+//  Strassen-Winograd recursive multiplication on top of gemm.h
+//  Created 16.10.2026
+//
+//  C = A * B for square row-major 'size'x'size' matrices in O(n^2.81). Each
+//  level splits the operands in 2x2 quadrants and computes the 7 products of
+//  the Winograd variant as OpenMP tasks; below 'cutoff' the blocked kernel of
+//  gemm.h takes over. Sizes that are not cutoff * 2^d are zero padded once.
+
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include <math.h>
+#include "gemm.h"
+
+#ifndef STRASSEN_CUTOFF
+#define STRASSEN_CUTOFF 512     // default leaf size
+#endif
+#define STRASSEN_TASK_DEPTH 3   // levels whose products become tasks (7^3 leaves)
+#define STRASSEN_PAD 8          // extra row length of all buffers, avoids power-of-2 strides
+
+//-- ----------------------------------------------------------------------------
+// Pack a whole 'k'x'n' block of B (row stride 'ldb') into Bp, sequentially
+// (the leaves run as tasks)
+static void strassen_pack_block(int k, int n, const double *B, int ldb, double *Bp) {
+    int panel, NR = gemm_init()->nr;
+
+    for (panel = 0; panel < (n + NR - 1) / NR; panel++)
+        gemm_pack_panel(k, n, B, ldb, Bp, panel);
+}
+
+// C[n x n] = A[n x n] * B[n x n] (row strides 'lda', 'ldb', 'ldc'), C overwritten.
+// Must be called from within a parallel region (single) to use the tasks.
+static void strassen_rec(int n, const double *A, int lda, const double *B, int ldb,
+                         double *C, int ldc, int cutoff, int depth) {
+    int h = n / 2, hs = h + STRASSEN_PAD, i;
+    long hh = (long) h * hs;
+
+    if (n <= cutoff || n % 2) { // leaf: pack B (strides are often powers of 2) and use the blocked kernel
+        double *Bp = matrix_alloc_heap(gemm_packed_b_size(n));  // short-lived, kept out of the arena
+        if (Bp == NULL) {
+            fprintf(stderr, "** Error in Strassen leaf: insufficient memory **");
+            fprintf(stderr, "** Program aborted................................ **");
+            exit(1);
+        }
+        strassen_pack_block(n, n, B, ldb, Bp);
+        for (i = 0; i < n; i++)
+            memset(C + (long) i * ldc, 0, n * sizeof(double));
+        gemm_blocked(n, n, n, A, lda, B, ldb, Bp, C, ldc);
+        free(Bp);
+        return;
+    }
+
+    const double *A11 = A, *A12 = A + h, *A21 = A + (long) h * lda, *A22 = A21 + h;
+    const double *B11 = B, *B12 = B + h, *B21 = B + (long) h * ldb, *B22 = B21 + h;
+    double *C11 = C, *C12 = C + h, *C21 = C + (long) h * ldc, *C22 = C21 + h;
+    double *buf = (double *) malloc(15 * hh * sizeof(double));
+    if (buf == NULL) {
+        fprintf(stderr, "** Error in Strassen temporaries: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    double *S1 = buf, *S2 = S1 + hh, *S3 = S2 + hh, *S4 = S3 + hh;
+    double *T1 = S4 + hh, *T2 = T1 + hh, *T3 = T2 + hh, *T4 = T3 + hh;
+    double *P1 = T4 + hh, *P2 = P1 + hh, *P3 = P2 + hh, *P4 = P3 + hh;
+    double *P5 = P4 + hh, *P6 = P5 + hh, *P7 = P6 + hh;
+
+    // Winograd's 8 additions on the operands
+#pragma omp taskloop if (depth == 0)
+    for (i = 0; i < h; i++) {
+        int j;
+        for (j = 0; j < h; j++) {
+            long a = (long) i * lda + j, b = (long) i * ldb + j, t = (long) i * hs + j;
+            S1[t] = A21[a] + A22[a];
+            S2[t] = S1[t] - A11[a];
+            S3[t] = A11[a] - A21[a];
+            S4[t] = A12[a] - S2[t];
+            T1[t] = B12[b] - B11[b];
+            T2[t] = B22[b] - T1[t];
+            T3[t] = B22[b] - B12[b];
+            T4[t] = T2[t] - B21[b];
+        }
+    }
+
+    // The 7 products are independent
+#pragma omp task if (depth < STRASSEN_TASK_DEPTH)
+    strassen_rec(h, A11, lda, B11, ldb, P1, hs, cutoff, depth + 1);
+#pragma omp task if (depth < STRASSEN_TASK_DEPTH)
+    strassen_rec(h, A12, lda, B21, ldb, P2, hs, cutoff, depth + 1);
+#pragma omp task if (depth < STRASSEN_TASK_DEPTH)
+    strassen_rec(h, S4, hs, B22, ldb, P3, hs, cutoff, depth + 1);
+#pragma omp task if (depth < STRASSEN_TASK_DEPTH)
+    strassen_rec(h, A22, lda, T4, hs, P4, hs, cutoff, depth + 1);
+#pragma omp task if (depth < STRASSEN_TASK_DEPTH)
+    strassen_rec(h, S1, hs, T1, hs, P5, hs, cutoff, depth + 1);
+#pragma omp task if (depth < STRASSEN_TASK_DEPTH)
+    strassen_rec(h, S2, hs, T2, hs, P6, hs, cutoff, depth + 1);
+#pragma omp task if (depth < STRASSEN_TASK_DEPTH)
+    strassen_rec(h, S3, hs, T3, hs, P7, hs, cutoff, depth + 1);
+#pragma omp taskwait
+
+    // and Winograd's 7 additions to assemble C
+#pragma omp taskloop if (depth == 0)
+    for (i = 0; i < h; i++) {
+        int j;
+        for (j = 0; j < h; j++) {
+            long c = (long) i * ldc + j, t = (long) i * hs + j;
+            double u2 = P1[t] + P6[t], u3 = u2 + P7[t], u4 = u2 + P5[t];
+            C11[c] = P1[t] + P2[t];
+            C12[c] = u4 + P3[t];
+            C21[c] = u3 - P4[t];
+            C22[c] = u3 + P5[t];
+        }
+    }
+    free(buf);
+}
+
+//-- ----------------------------------------------------------------------------
+// C = A * B with Strassen-Winograd down to leaves of at most 'cutoff'.
+// 'size' is rounded up to q * 2^d (q <= cutoff) so any size works (9800
+// becomes 9824 with the default cutoff); the operands are copied, zero padded,
+// into buffers whose rows are STRASSEN_PAD longer.
+static void strassen_multiply(int size, const double *A, const double *B, double *C, int cutoff) {
+    int d = 0, m, ms, q, i;
+
+    while ((size + (1 << d) - 1) >> d > cutoff) d++;
+    q = (size + (1 << d) - 1) >> d;
+    m = q << d;
+    ms = m + STRASSEN_PAD;
+
+    double *Ap = (double *) calloc((long) m * ms, sizeof(double));
+    double *Bp = (double *) calloc((long) m * ms, sizeof(double));
+    double *Cp = (double *) malloc((long) m * ms * sizeof(double));
+    if (Ap == NULL || Bp == NULL || Cp == NULL) {
+        fprintf(stderr, "** Error in Strassen padding: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < size; i++) {
+        memcpy(Ap + (long) i * ms, A + (long) i * size, size * sizeof(double));
+        memcpy(Bp + (long) i * ms, B + (long) i * size, size * sizeof(double));
+    }
+#pragma omp parallel
+#pragma omp single
+    strassen_rec(m, Ap, ms, Bp, ms, Cp, ms, cutoff, 0);
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < size; i++)
+        memcpy(C + (long) i * size, Cp + (long) i * ms, size * sizeof(double));
+    free(Ap);
+    free(Bp);
+    free(Cp);
+}
+
+//-- ----------------------------------------------------------------------------
+// Numerical drift of C against the naive triple loop, on 'samples' rows spread
+// over the matrix (O(samples * size^2)). Prints the largest absolute error and
+// the largest error relative to the magnitude of the naive dot product.
+static void strassen_error_report(int size, const double *A, const double *B, const double *C, int samples) {
+    double maxAbs = 0, maxRel = 0;
+    int s, j, k;
+
+    if (samples > size) samples = size;
+#pragma omp parallel for private(j,k) reduction(max:maxAbs,maxRel) schedule(static)
+    for (s = 0; s < samples; s++) {
+        int i = (int) ((long) s * size / samples);
+        for (j = 0; j < size; j++) {
+            double ref = 0, mag = 0, err;
+            for (k = 0; k < size; k++) {
+                ref += A[(long) i * size + k] * B[(long) k * size + j];
+                mag += fabs(A[(long) i * size + k] * B[(long) k * size + j]);
+            }
+            err = fabs(C[(long) i * size + j] - ref);
+            if (err > maxAbs) maxAbs = err;
+            if (mag > 0 && err / mag > maxRel) maxRel = err / mag;
+        }
+    }
+    printf("strassenError (vs naive, %d rows)\tmaxAbs=%g\tmaxRel=%g\n", samples, maxAbs, maxRel);
+}
+
+#endif // STRASSEN_H
@@ -0,0 +1,256 @@
+//-- ----------------------------------------------------------------------------*/
+//  Per-host tuning of the blocked kernel (tune option of MOMP)
+//  Created 16.10.2026
+//
+//  The best block sizes of gemm.h, OpenMP thread count and schedule of the
+//  row loops depend on the caches and cores of each host. tune_search
+//  measures candidates on the local node: a coordinate search over KC, MC
+//  and NC with all threads, then every thread count with every schedule
+//  kind. tune_save writes the winner to a per-host cache file that the
+//  drivers read at startup with tune_load.
+//
+//  Cache file: $TUNE_CACHE, or $HOME/.matrixmult-<host>.tune (the host name
+//  keeps the hosts of a shared home directory apart); TUNE_CACHE=none
+//  ignores it. One key=value per line, '#' starts a comment. An entry tuned
+//  for another micro kernel (GEMM_KERNEL) is ignored. OMP_NUM_THREADS and
+//  OMP_SCHEDULE, when set, win over the cached values. Without OpenMP
+//  (MStandard) only the block sizes are loaded.
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "gemm.h"
+#include "bench.h"
+
+#define TUNE_SIZE 1536      // default size of the tuning multiplies
+#define TUNE_REPS 3         // timed runs per candidate (median), after one warm-up
+
+typedef struct {
+    char kernel[16];        // micro kernel the entry was tuned with
+    int mc, kc, nc;         // block sizes of gemm.h
+    int threads;            // OpenMP threads per process
+    int ranks;              // suggested processes per node (cores / threads)
+    int schedule;           // schedule of the row loops (schedule(runtime)), an omp_sched_t
+    int chunk;
+    int size;               // size the entry was tuned with
+    double gflops;          // and its speed
+} tune_config_t;
+
+enum { TUNE_STATIC = 1, TUNE_DYNAMIC, TUNE_GUIDED, TUNE_AUTO };   // values of omp_sched_t
+
+static const char *tune_schedule_names[] = {"", "static", "dynamic", "guided", "auto"};
+
+//-- ----------------------------------------------------------------------------
+// Path of the cache file of this host into 'path'; NULL if disabled
+static char *tune_cache_path(char *path, size_t len) {
+    const char *env = getenv("TUNE_CACHE"), *home = getenv("HOME");
+    char host[256] = "localhost";
+
+    if (env != NULL) {
+        if (strcmp(env, "none") == 0) return NULL;
+        snprintf(path, len, "%s", env);
+        return path;
+    }
+    gethostname(host, sizeof(host) - 1);
+    snprintf(path, len, "%s/.matrixmult-%s.tune", home != NULL ? home : ".", host);
+    return path;
+}
+
+static int tune_parse_schedule(const char *name) {
+    int s;
+
+    for (s = TUNE_STATIC; s <= TUNE_GUIDED; s++)
+        if (strcmp(name, tune_schedule_names[s]) == 0) return s;
+    return TUNE_AUTO;
+}
+
+//-- ----------------------------------------------------------------------------
+// Write 'cfg' to the cache file of this host. Returns 0 on success.
+static inline int tune_save(const tune_config_t *cfg) {
+    char path[1024], host[256] = "localhost";
+    FILE *f;
+
+    if (tune_cache_path(path, sizeof(path)) == NULL) return 0;
+    if ((f = fopen(path, "w")) == NULL) {
+        fprintf(stderr, "** Cannot write tuning cache %s **\n", path);
+        return -1;
+    }
+    gethostname(host, sizeof(host) - 1);
+    fprintf(f, "# MatrixMult tuning of %s (%d cores), size %d: %.2f GFLOP/s\n", host, cfg->threads * cfg->ranks,
+            cfg->size, cfg->gflops);
+    fprintf(f, "kernel=%s\nmc=%d\nkc=%d\nnc=%d\nthreads=%d\nranks=%d\nschedule=%s\nchunk=%d\nsize=%d\ngflops=%.2f\n",
+            cfg->kernel, cfg->mc, cfg->kc, cfg->nc, cfg->threads, cfg->ranks, tune_schedule_names[cfg->schedule],
+            cfg->chunk, cfg->size, cfg->gflops);
+    fclose(f);
+    printf("Tuning saved to %s\n", path);
+    return 0;
+}
+
+//-- ----------------------------------------------------------------------------
+// Read the cache file of this host into 'cfg' and apply it: block sizes,
+// schedule, and the thread count if 'threads' is set. Without a usable entry
+// the row loops keep the static schedule. Returns 1 if an entry was applied.
+static int tune_load(tune_config_t *cfg, int threads, int debug) {
+    const gemm_kernel_t *kern = gemm_init();
+    char path[1024], line[256], key[16], value[16];
+    tune_config_t c = {"", GEMM_MC, GEMM_KC, GEMM_NC, 0, 0, TUNE_STATIC, 0, 0, 0};
+    FILE *f;
+
+    *cfg = c;
+#ifdef _OPENMP
+    if (getenv("OMP_SCHEDULE") == NULL) omp_set_schedule(omp_sched_static, 0);
+#endif
+    if (tune_cache_path(path, sizeof(path)) == NULL || (f = fopen(path, "r")) == NULL) return 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%15[^=]=%15s", key, value) != 2) continue;
+        if (strcmp(key, "kernel") == 0) snprintf(c.kernel, sizeof(c.kernel), "%s", value);
+        else if (strcmp(key, "mc") == 0) c.mc = atoi(value);
+        else if (strcmp(key, "kc") == 0) c.kc = atoi(value);
+        else if (strcmp(key, "nc") == 0) c.nc = atoi(value);
+        else if (strcmp(key, "threads") == 0) c.threads = atoi(value);
+        else if (strcmp(key, "ranks") == 0) c.ranks = atoi(value);
+        else if (strcmp(key, "schedule") == 0) c.schedule = tune_parse_schedule(value);
+        else if (strcmp(key, "chunk") == 0) c.chunk = atoi(value);
+        else if (strcmp(key, "size") == 0) c.size = atoi(value);
+        else if (strcmp(key, "gflops") == 0) c.gflops = atof(value);
+    }
+    fclose(f);
+    if (strcmp(c.kernel, kern->name) != 0) {
+        if (debug) fprintf(stderr, "Tuning cache %s ignored (kernel %s, not %s)\n", path, c.kernel, kern->name);
+        return 0;
+    }
+    if (c.mc <= 0 || c.kc <= 0 || c.nc <= 0) {
+        if (debug) fprintf(stderr, "Tuning cache %s ignored (MC=%d KC=%d NC=%d not positive)\n", path, c.mc, c.kc,
+                           c.nc);
+        return 0;
+    }
+    if (c.nc % kern->nr != 0) {
+        if (debug) fprintf(stderr, "Tuning cache %s ignored (nc=%d not a multiple of NR=%d)\n", path, c.nc, kern->nr);
+        return 0;
+    }
+    *cfg = c;
+    gemm_mc = c.mc;
+    gemm_kc = c.kc;
+    gemm_nc = c.nc;
+#ifdef _OPENMP
+    if (getenv("OMP_SCHEDULE") == NULL) omp_set_schedule((omp_sched_t) c.schedule, c.chunk);
+    if (threads && c.threads > 0 && getenv("OMP_NUM_THREADS") == NULL) omp_set_num_threads(c.threads);
+#endif
+    if (debug) fprintf(stderr, "Tuning cache %s: MC=%d KC=%d NC=%d, %d threads, %s schedule\n", path, c.mc, c.kc,
+                       c.nc, c.threads, tune_schedule_names[c.schedule]);
+    return 1;
+}
+
+#ifdef _OPENMP
+//-- ----------------------------------------------------------------------------
+// Median GFLOP/s of C = A * B with the current block sizes, 'threads' threads
+// and schedule (B is already packed into Bp)
+static inline double tune_measure(int size, const double *A, const double *B, const double *Bp, double *C,
+                                  int threads, int schedule, int chunk) {
+    double samples[TUNE_REPS], t;
+    int r, i;
+
+    omp_set_schedule((omp_sched_t) schedule, chunk);
+    for (r = -1; r < TUNE_REPS; r++) {
+        t = bench_now();
+#pragma omp parallel for schedule(runtime) num_threads(threads)
+        for (i = 0; i < size; i += gemm_mc)
+            gemm_block_rows_ex(size, A, B, Bp, C, i, GEMM_MIN(i + gemm_mc, size));
+        if (r >= 0) samples[r] = bench_now() - t;
+    }
+    qsort(samples, TUNE_REPS, sizeof(double), bench_cmp);
+    return 2.0 * size * size * (double) size / samples[TUNE_REPS / 2] / 1e9;
+}
+
+//-- ----------------------------------------------------------------------------
+// Search the best configuration of this node for 'size'x'size' multiplies
+// and return it in 'best'
+static inline void tune_search(int size, int debug, tune_config_t *best) {
+    static const int kcs[] = {128, 192, 256, 320, 384, 512};
+    static const int mcs[] = {4, 8, 12, 16, 24, 32};          // times the kernel MR
+    static const int ncs[] = {512, 1024, 2048, 4096, 8192};
+    static const int scheds[] = {TUNE_STATIC, TUNE_DYNAMIC, TUNE_GUIDED};
+    const gemm_kernel_t *kern = gemm_init();
+    int procs = omp_get_num_procs(), i, t, s;
+    double g;
+
+    double *A = matrix_alloc_heap((size_t) size * size);
+    double *B = matrix_alloc_heap((size_t) size * size);
+    double *C = matrix_alloc_heap((size_t) size * size);
+    double *Bp = matrix_alloc_heap(gemm_packed_b_size(size));
+    if (A == NULL || B == NULL || C == NULL || Bp == NULL) {
+        fprintf(stderr, "** Error in tuning: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < size; i++) {
+        int j;
+        for (j = 0; j < size; j++) {
+            A[(long) i * size + j] = (i + j) % 10;
+            B[(long) i * size + j] = (i * j) % 10;
+        }
+    }
+    gemm_pack_b(size, B, Bp);
+
+    snprintf(best->kernel, sizeof(best->kernel), "%s", kern->name);
+    best->mc = gemm_mc = GEMM_MC;
+    best->kc = gemm_kc = GEMM_KC;
+    best->nc = gemm_nc = GEMM_NC;
+    best->threads = procs;
+    best->schedule = TUNE_STATIC;
+    best->chunk = 0;
+    best->size = size;
+    best->gflops = tune_measure(size, A, B, Bp, C, procs, TUNE_STATIC, 0);
+    if (debug) fprintf(stderr, "tune default\tMC=%d KC=%d NC=%d\t%.2f GFLOP/s\n", gemm_mc, gemm_kc, gemm_nc,
+                       best->gflops);
+
+    // Block sizes, one at a time, with all the cores
+#define TUNE_TRY(var, value) do {                                                               \
+        var = (value);                                                                          \
+        g = tune_measure(size, A, B, Bp, C, procs, TUNE_STATIC, 0);                             \
+        if (debug) fprintf(stderr, "tune blocks\tMC=%d KC=%d NC=%d\t%.2f GFLOP/s\n", gemm_mc,   \
+                           gemm_kc, gemm_nc, g);                                                \
+        if (g > best->gflops) {                                                                 \
+            best->gflops = g;                                                                   \
+            best->mc = gemm_mc; best->kc = gemm_kc; best->nc = gemm_nc;                         \
+        }                                                                                       \
+        gemm_mc = best->mc; gemm_kc = best->kc; gemm_nc = best->nc;                             \
+    } while (0)
+    for (i = 0; i < (int) (sizeof(kcs) / sizeof(kcs[0])); i++)
+        if (kcs[i] != best->kc && kcs[i] < size) TUNE_TRY(gemm_kc, kcs[i]);
+    for (i = 0; i < (int) (sizeof(mcs) / sizeof(mcs[0])); i++)
+        if (mcs[i] * kern->mr != best->mc && mcs[i] * kern->mr < size) TUNE_TRY(gemm_mc, mcs[i] * kern->mr);
+    for (i = 0; i < (int) (sizeof(ncs) / sizeof(ncs[0])); i++)  // beyond the size all NC are the same
+        if (ncs[i] != best->nc && (i == 0 || ncs[i - 1] < size)) TUNE_TRY(gemm_nc, ncs[i]);
+#undef TUNE_TRY
+
+    // Threads and schedule: 1, 2, 4... and all the cores
+    for (t = 1; t <= procs; t = t < procs && t * 2 > procs ? procs : t * 2) {
+        for (s = 0; s < (t > 1 ? 3 : 1); s++) {
+            g = tune_measure(size, A, B, Bp, C, t, scheds[s], scheds[s] == TUNE_STATIC ? 0 : 1);
+            if (debug) fprintf(stderr, "tune threads\t%d threads, %s\t%.2f GFLOP/s\n", t,
+                               tune_schedule_names[scheds[s]], g);
+            if (g > best->gflops) {
+                best->gflops = g;
+                best->threads = t;
+                best->schedule = scheds[s];
+                best->chunk = scheds[s] == TUNE_STATIC ? 0 : 1;
+            }
+        }
+        if (t == procs) break;
+    }
+    best->ranks = procs / best->threads;
+
+    free(A);
+    free(B);
+    free(C);
+    free(Bp);
+}
+#endif // _OPENMP
+
+#endif // TUNE_H
@@ -0,0 +1,208 @@
+//-- ----------------------------------------------------------------------------*/
+//  Fast verification of C = A * B in O(n^2) (verify and checksum options)
+//  Created 16.10.2026
+//
+//  Freivalds: for a random vector x, A * (B * x) must equal C * x. Each round
+//  costs three matrix-vector products instead of a multiply; a wrong C
+//  passes a round with a random real x with probability ~0.
+//  Checksum: the sum of the elements of a row block of C must equal the
+//  block of A times the row sums of B (x = 1, the ABFT checksum of Huang and
+//  Abraham), so every rank checks its own stripe without sending C anywhere.
+//  It is coarser than Freivalds: an error must exceed the rounding of the
+//  whole stripe, while Freivalds compares row by row.
+//  In floating point both sides differ by rounding: errors are relative to
+//  the same products on the absolute values (|A| * |B| * |x|) and accepted
+//  below VERIFY_TOL, a few times the worst case bound of the dot products.
+//  All loops run over rows, in parallel with OpenMP.
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#define VERIFY_TOL(n) (4.0 * (n) * DBL_EPSILON)
+
+//-- ----------------------------------------------------------------------------
+// Pseudo random vector in [-1, 1) (splitmix64), the same on every rank for a seed
+static void verify_vector(double *x, int n, unsigned long seed) {
+    uint64_t s = seed;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        x[i] = (double) ((z ^ (z >> 31)) >> 11) / 4503599627370496.0 - 1.0;  // 53 bits / 2^52 - 1
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// y = M * x and yabs = |M| * |x| for the 'rows'x'n' matrix M
+static void verify_matvec(int rows, int n, const double *M, const double *x, double *y, double *yabs) {
+    int i, k;
+
+#pragma omp parallel for private(k) schedule(static)
+    for (i = 0; i < rows; i++) {
+        const double *m = M + (long) i * n;
+        double s = 0, a = 0;
+        for (k = 0; k < n; k++) {
+            s += m[k] * x[k];
+            a += fabs(m[k] * x[k]);
+        }
+        y[i] = s;
+        yabs[i] = a;
+    }
+}
+
+//-- ----------------------------------------------------------------------------
+// Largest relative difference between A * y and C * x over 'rows' rows of
+// width 'n' (y = B * x, yabs = |B| * |x|)
+static double verify_rows(int rows, int n, const double *A, const double *C, const double *x,
+                          const double *y, const double *yabs) {
+    double maxErr = 0;
+    int i, k;
+
+#pragma omp parallel for private(k) reduction(max:maxErr) schedule(static)
+    for (i = 0; i < rows; i++) {
+        const double *a = A + (long) i * n, *c = C + (long) i * n;
+        double z = 0, zabs = 0, w = 0, err;
+        for (k = 0; k < n; k++) {
+            z += a[k] * y[k];
+            zabs += fabs(a[k]) * yabs[k];
+            w += c[k] * x[k];
+        }
+        err = fabs(z - w);
+        err = zabs > 0 ? err / zabs : (err > 0 ? INFINITY : 0);
+        if (err != err) err = INFINITY;         // NaN in C (or in the operands)
+        if (err > maxErr) maxErr = err;
+    }
+    return maxErr;
+}
+
+//-- ----------------------------------------------------------------------------
+// Checksum of 'rows' rows of C: sum[0] = sum of the elements, sum[1] = the
+// expected sum A * bsum, sum[2] = its magnitude |A| * babs
+// (bsum = B * 1 and babs = |B| * 1). Rows are summed first, then the row
+// sums, which keeps the rounding error within VERIFY_TOL(n + rows).
+static void verify_checksum(int rows, int n, const double *A, const double *C, const double *bsum,
+                            const double *babs, double sum[3]) {
+    double s = 0, e = 0, m = 0;
+    int i, k;
+
+#pragma omp parallel for private(k) reduction(+:s,e,m) schedule(static)
+    for (i = 0; i < rows; i++) {
+        const double *a = A + (long) i * n, *c = C + (long) i * n;
+        double rs = 0, re = 0, rm = 0;
+        for (k = 0; k < n; k++) {
+            rs += c[k];
+            re += a[k] * bsum[k];
+            rm += fabs(a[k]) * babs[k];
+        }
+        s += rs;
+        e += re;
+        m += rm;
+    }
+    sum[0] = s;
+    sum[1] = e;
+    sum[2] = m;
+}
+
+// Relative error of a checksum (see verify_checksum)
+static double verify_checksum_error(const double sum[3]) {
+    double err = fabs(sum[0] - sum[1]);
+    err = sum[2] > 0 ? err / sum[2] : (err > 0 ? INFINITY : 0);
+    return err != err ? INFINITY : err;
+}
+
+//-- ----------------------------------------------------------------------------
+// Freivalds check of a whole 'size'x'size' product in one process: largest
+// relative error over 'rounds' random vectors drawn from 'seed'
+static inline double verify_freivalds(int size, const double *A, const double *B, const double *C, int rounds,
+                                      unsigned long seed) {
+    double *x = (double *) malloc(3 * (size_t) size * sizeof(double)), *y = x + size, *yabs = y + size;
+    double err, maxErr = 0;
+    int r;
+
+    if (x == NULL) {
+        fprintf(stderr, "** Error in verification: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    for (r = 0; r < rounds; r++) {
+        verify_vector(x, size, seed + r);
+        verify_matvec(size, size, B, x, y, yabs);
+        err = verify_rows(size, size, A, C, x, y, yabs);
+        if (err > maxErr) maxErr = err;
+    }
+    free(x);
+    return maxErr;
+}
+
+// Checksum of a whole 'size'x'size' product in one process (see verify_checksum)
+static inline void verify_checksum_all(int size, const double *A, const double *B, const double *C, double sum[3]) {
+    double *one = (double *) malloc(3 * (size_t) size * sizeof(double)), *bsum = one + size, *babs = bsum + size;
+    int i;
+
+    if (one == NULL) {
+        fprintf(stderr, "** Error in verification: insufficient memory **");
+        fprintf(stderr, "** Program aborted................................ **");
+        exit(1);
+    }
+    for (i = 0; i < size; i++) one[i] = 1;
+    verify_matvec(size, size, B, one, bsum, babs);
+    verify_checksum(size, size, A, C, bsum, babs, sum);
+    free(one);
+}
+
+//-- ----------------------------------------------------------------------------
+// Seed of the random vectors, different on every run unless VERIFY_SEED is set
+// (the seed is printed, to replay a check)
+static unsigned long verify_seed(void) {
+    const char *env = getenv("VERIFY_SEED");
+
+    if (env != NULL) return strtoul(env, NULL, 10);
+    return (unsigned long) time(NULL) ^ ((unsigned long) getpid() << 20);
+}
+
+// Print the result of a Freivalds check; returns 1 if it failed
+static int verify_report_freivalds(double err, int size, int rounds, unsigned long seed) {
+    int failed = !(err <= VERIFY_TOL(size));
+
+    printf("verify=freivalds\trounds=%d\tseed=%lu\tmaxRelErr=%g\ttol=%g\t%s\n", rounds, seed, err,
+           VERIFY_TOL(size), failed ? "FAILED" : "PASSED");
+    return failed;
+}
+
+// Print the checksum of the rows 'r0'..'r1'-1 of C; returns 1 if it failed
+static int verify_report_checksum(const double sum[3], int size, int r0, int r1) {
+    double err = verify_checksum_error(sum);
+    int failed = !(err <= VERIFY_TOL(size + r1 - r0));
+
+    printf("checksum\trows=%d-%d\tsum=%.17g\texpected=%.17g\trelErr=%g\t%s\n", r0, r1 - 1, sum[0], sum[1], err,
+           failed ? "FAILED" : "PASSED");
+    return failed;
+}
+
+//-- ----------------------------------------------------------------------------
+// Checks of a product computed by one process: 'rounds' Freivalds rounds (if
+// any) and the checksum (if 'checksum'). Returns 1 if a check failed.
+static inline int verify_product(int size, const double *A, const double *B, const double *C, int rounds,
+                                 int checksum) {
+    unsigned long seed = verify_seed();
+    double sum[3];
+    int failed = 0;
+
+    if (rounds > 0)
+        failed |= verify_report_freivalds(verify_freivalds(size, A, B, C, rounds, seed), size, rounds, seed);
+    if (checksum) {
+        verify_checksum_all(size, A, B, C, sum);
+        failed |= verify_report_checksum(sum, size, 0, size);
+    }
+    return failed;
+}
+
+#endif // VERIFY_H